@@ -1,5 +1,6 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
 
 struct light
 {
@@ -122,14 +123,24 @@ layout(location = 0) in vec2 fragTexCoord;
 layout(location = 1) in vec3 vViewPos;
 layout(location = 2) in vec3 vViewNormal;
 layout(location = 3) in mat4 vView;
+// Materials are in object order
+layout(location = 7) flat in uint vObjectIndex;
 
-layout(binding = 1) uniform sampler2D texSampler;
+// Texture slots of each map: x base color, y emissive
+layout(std430, binding = 2) readonly buffer Materials {
+    uvec4 materials[];
+};
+
+layout(binding = 3) uniform sampler2D textures[];
+
+const uint NO_TEXTURE = 0xFFFFFFFFu;
 
 layout(location = 0) out vec4 outColor;
 
 void main()
 {
-    outColor = texture(texSampler, fragTexCoord);
+    uvec4 material = materials[vObjectIndex];
+    outColor = texture(textures[material.x], fragTexCoord);
 
     // Compute phong shading
     vec3 phongColor = gDefaultMaterial.emission;
@@ -142,4 +153,8 @@ void main()
     
     // Apply light color
     outColor.rgb *= phongColor;
+
+    // Emitted light is not shaded
+    if (material.y != NO_TEXTURE)
+        outColor.rgb += texture(textures[material.y], fragTexCoord).rgb;
 }
\ No newline at end of file
@@ -1,11 +1,24 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
+layout(binding = 0) uniform FrameUniforms {
     mat4 view;
     mat4 proj;
-} ubo;
+} frame;
+
+struct ObjectData
+{
+    mat4 model;
+    vec4 positionScale;
+    vec4 positionOffset;
+};
+
+layout(std430, binding = 1) readonly buffer Objects {
+    ObjectData objects[];
+};
+
+// 0: float vertices, 1: packed vertices (unorm16 position, octahedral normal, half texcoord)
+layout(constant_id = 0) const uint VERTEX_FORMAT = 0;
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormals;
@@ -15,15 +28,30 @@ layout(location = 0) out vec2 fragTexCoord;
 layout(location = 1) out vec3 vViewPos;
 layout(location = 2) out vec3 vViewNormal;
 layout(location = 3) out mat4 vView;
+layout(location = 7) flat out uint vObjectIndex;
 
+vec3 OctDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
 
 void main()
 {
+    // Every draw is one instance, firstInstance selects the object
+    ObjectData object = objects[gl_InstanceIndex];
+    vec3 position = object.positionOffset.xyz + inPosition * object.positionScale.xyz;
+    vec3 normal = VERTEX_FORMAT == 1 ? OctDecode(inNormals.xy) : inNormals;
+
+    vObjectIndex = uint(gl_InstanceIndex);
     fragTexCoord = inTexCoord;
-    vView = ubo.view;
-    mat4 modelView = ubo.view * ubo.model;
-    vec4 viewPos4 = (modelView * vec4(inPosition, 1.0));
+    vView = frame.view;
+    mat4 modelView = frame.view * object.model;
+    vec4 viewPos4 = (modelView * vec4(position, 1.0));
     vViewPos = viewPos4.xyz / viewPos4.w;
-    vViewNormal = (transpose(inverse(modelView)) * vec4(inNormals, 0.0)).xyz;
-    gl_Position = ubo.proj * viewPos4;
+    vViewNormal = (transpose(inverse(modelView)) * vec4(normal, 0.0)).xyz;
+    gl_Position = frame.proj * viewPos4;
 }
\ No newline at end of file
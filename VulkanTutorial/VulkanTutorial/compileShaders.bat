@@ -1,4 +1,5 @@
 C:\VulkanSDK\1.1.130.0\Bin32\glslangValidator.exe Shader/shader.vert -V Shader/vert.spv
 C:\VulkanSDK\1.1.130.0\Bin32\glslangValidator.exe Shader/shader.frag -V Shader/frag.spv
+C:\VulkanSDK\1.1.130.0\Bin32\glslangValidator.exe Shader/cull.comp -V Shader/cull.spv
 
 pause
\ No newline at end of file
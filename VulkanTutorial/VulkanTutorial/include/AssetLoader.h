@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Context.h"
+#include "Mesh.h"
+#include "StagingRing.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct LoadedTexture
+{
+	Mesh*			mesh;
+	MaterialTexture	map;
+	// A reference the receiver takes over
+	TextureHandle	texture;
+};
+
+// Loads meshes in the background: parsing and decoding run on a loader thread (and the thread
+// pool under it), uploads go through an upload context with its own command pool and staging ring.
+// Geometry and texture are handed over separately, each once its staging batch completed, so a
+// mesh can be drawn with a placeholder meanwhile.
+// Textures go through the TextureManager, a file already loaded is shared instead of decoded again.
+class AssetLoader
+{
+public:
+	AssetLoader() = default;
+	~AssetLoader() = default;
+
+	void Create(Context context, TextureManager* textureManager);
+	void Destroy(VkDevice device);
+
+	void RequestMesh(const std::string& modelFile, const MaterialFiles& material, const MeshLoadSettings& settings = MeshLoadSettings());
+
+	// Appends the meshes whose geometry became resident since the last call, ownership moves to the caller
+	void TakeMeshes(std::vector<Mesh*>& meshes);
+	// Appends the textures finished since the last call, always for meshes already taken
+	void TakeTextures(std::vector<LoadedTexture>& textures);
+
+	// Blocks until every request so far is resident
+	void WaitIdle();
+
+private:
+	struct MeshRequest
+	{
+		std::string			modelFile;
+		MaterialFiles		material;
+		MeshLoadSettings	settings;
+	};
+
+	CommandPool						_uploadPool;
+	StagingRing						_staging;
+	TextureManager*					_textureManager = nullptr;
+	std::thread						_thread;
+	std::mutex						_mutex;
+	std::condition_variable			_condition;
+	std::condition_variable			_idleCondition;
+	std::deque<MeshRequest>			_requests;
+	std::vector<Mesh*>				_loadedMeshes;
+	std::vector<LoadedTexture>		_loadedTextures;
+	bool							_busy = false;
+	bool							_stop = false;
+
+	void ThreadMain(Context uploadContext);
+	// Everything queued when the loader wakes up is loaded as one batch, its new textures
+	// decoded together on the pool while the meshes are parsed
+	void LoadBatch(Context uploadContext, std::vector<MeshRequest>& requests);
+};
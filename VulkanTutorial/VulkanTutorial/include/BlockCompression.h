@@ -0,0 +1,30 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <vector>
+
+enum BlockFormat : uint32_t
+{
+	// RGB, 8 bytes per 4x4 block
+	BLOCK_FORMAT_BC1 = 0,
+	// RGBA, BC1 color and a BC4 alpha block, 16 bytes
+	BLOCK_FORMAT_BC3,
+	// Two channel (RG, e.g. normal maps), two BC4 blocks, 16 bytes
+	BLOCK_FORMAT_BC5,
+	// RGBA, mode 6 only, 16 bytes
+	BLOCK_FORMAT_BC7,
+	BLOCK_FORMAT_COUNT
+};
+
+VkFormat GetBlockVkFormat(BlockFormat format);
+uint32_t GetBlockSize(BlockFormat format);
+// Maps a VkFormat back to its BlockFormat, false for formats this encoder does not produce
+bool GetBlockFormat(VkFormat vkFormat, BlockFormat& format);
+bool ParseBlockFormat(const char* name, BlockFormat& format);
+
+// Compresses a width x height RGBA8 image, blocks past the edges replicate the last row and column.
+// Rows of blocks are encoded in parallel on the thread pool.
+void CompressImage(const unsigned char* pixels, uint32_t width, uint32_t height, BlockFormat format, std::vector<unsigned char>& output);
@@ -0,0 +1,23 @@
+#pragma once
+
+#define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES
+#include <glm/glm.hpp>
+
+#include <cfloat>
+
+struct Bounds
+{
+	glm::vec3 min = glm::vec3(FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX);
+
+	inline void Extend(const glm::vec3& point)
+	{
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	inline bool IsValid() const { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+	inline glm::vec3 GetCenter() const { return (min + max) * 0.5f; }
+	inline glm::vec3 GetExtent() const { return max - min; }
+	inline float GetRadius() const { return glm::length(max - min) * 0.5f; }
+};
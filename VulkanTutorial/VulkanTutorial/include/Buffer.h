@@ -14,9 +14,14 @@ public:
 
 	Buffer& CreateBuffer(Context context, VkDeviceSize size, VkBufferUsageFlags usage,
 					VkMemoryPropertyFlags properties);
-	uint32_t FindMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties);
+	// Host visible buffer written in place through GetMappedData, for data rewritten every frame.
+	// The memory may not be coherent, writes are made visible with Flush.
+	Buffer& CreateMappedBuffer(Context context, VkDeviceSize size, VkBufferUsageFlags usage);
 
-	void MapMemory(VkDevice device, VkDeviceSize offset, VkDeviceSize size, VkMemoryMapFlags flags, void* data);
+	// Host visible memory stays mapped from creation to Destroy, null for device local buffers
+	template<typename T>
+	inline T* GetMappedData() const { return static_cast<T*>(_allocation.mapped); }
+	void Flush(VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
 
 	void CopyBuffer(Context context, Buffer& dstBuffer, VkDeviceSize size);
 
@@ -25,6 +30,6 @@ public:
 	inline const VkBuffer& GetBuffer() { return _buffer; };
 
 private:
-	VkBuffer						_buffer;
-	VkDeviceMemory					_bufferMemory;
+	VkBuffer						_buffer = VK_NULL_HANDLE;
+	MemoryAllocation				_allocation;
 };
\ No newline at end of file
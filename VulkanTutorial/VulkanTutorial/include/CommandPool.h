@@ -13,6 +13,8 @@ public:
 
 	CommandBuffer& AllocateCommandBuffer(VkDevice device, VkCommandBufferAllocateInfo* info, VkCommandBuffer* commandBuffer);
 	void FreeCommandBuffer(VkDevice device, uint32_t bufferCount, VkCommandBuffer* commandBuffer);
+	// Returns every buffer of the pool to the initial state at once, none may be pending
+	void Reset(VkDevice device, VkCommandPoolResetFlags flags = 0);
 
 	void Destroy(VkDevice device);
 
@@ -4,7 +4,12 @@
 #include <GLFW/glfw3.h>
 #include <vector>
 #include <optional>
+#include <mutex>
 #include "CommandPool.h"
+#include "MemoryAllocator.h"
+
+class StagingRing;
+class GeometryPool;
 
 class Context
 {
@@ -15,7 +20,19 @@ public:
 	CommandPool			commandPool;
 	VkQueue				graphicsQueue;
 	VkQueue 			presentQueue;
+	// Queue of the transfer only family, the graphics queue when the device has none
+	VkQueue				transferQueue;
 	VkSurfaceKHR 		surface;
+	// Held around every submission, present and device wait, the queues are shared with loader threads
+	std::mutex*			queueMutex = nullptr;
+	// Every buffer and image allocates its memory here, shared by all copies of the context
+	MemoryAllocator*	allocator = nullptr;
+	// Uploads of the thread using this copy, created for the render thread, loader threads set their own
+	StagingRing*		staging = nullptr;
+	// Vertex and index buffers every mesh sub-allocates its geometry from, shared by all copies
+	GeometryPool*		geometry = nullptr;
+	// VK_KHR_draw_indirect_count, null when the device lacks it or indirect draws with a first instance
+	PFN_vkCmdDrawIndexedIndirectCountKHR	cmdDrawIndexedIndirectCount = nullptr;
 
 
 	Context&			Create(GLFWwindow* window);
@@ -40,7 +57,8 @@ private:
 	};
 
 	const std::vector<const char*> _deviceExtensions{
-			VK_KHR_SWAPCHAIN_EXTENSION_NAME
+			VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+			VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME
 	};
 
 	VkDebugUtilsMessengerEXT		_debugMessenger;
@@ -64,6 +82,9 @@ private:
 	void CreateLogicalDevice();
 	void PickPhysicalDevice();
 	int RateDeviceSuitability(VkPhysicalDevice device);
+	bool SupportsExtension(VkPhysicalDevice device, const char* extensionName);
+	// Extension and the features the bindless texture array needs
+	bool SupportsDescriptorIndexing(VkPhysicalDevice device);
 	void CreateSurface(GLFWwindow* window);
 	void CreateCommandPool();
 };
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+
+#define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES
+#include <glm/glm.hpp>
+
+// View volume as six planes, a point p is inside when dot(plane.xyz, p) + plane.w >= 0 for all of them.
+// Normals are unit length so the plane equation gives a signed distance.
+struct Frustum
+{
+	// Left, right, bottom, top, near, far
+	glm::vec4 planes[6];
+
+	// Planes of a view projection matrix with Vulkan clip space (depth 0 to 1), in the space the matrix
+	// transforms from (Gribb and Hartmann 2001)
+	static inline Frustum FromMatrix(const glm::mat4& m)
+	{
+		const glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+		const glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+		const glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+		const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+		Frustum frustum;
+		frustum.planes[0] = row3 + row0;
+		frustum.planes[1] = row3 - row0;
+		frustum.planes[2] = row3 + row1;
+		frustum.planes[3] = row3 - row1;
+		frustum.planes[4] = row2;
+		frustum.planes[5] = row3 - row2;
+
+		for (glm::vec4& plane : frustum.planes)
+			plane /= glm::length(glm::vec3(plane));
+
+		return frustum;
+	}
+
+	inline bool IntersectsSphere(const glm::vec3& center, float radius) const
+	{
+		for (const glm::vec4& plane : planes)
+		{
+			if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+				return false;
+		}
+
+		return true;
+	}
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Buffer.h"
+#include "MemoryAllocator.h"
+
+#include <mutex>
+
+// Capacity of the shared vertex and index buffers, loads past it fail
+#define GEOMETRY_VERTEX_POOL_SIZE (256ull * 1024 * 1024)
+#define GEOMETRY_INDEX_POOL_SIZE (128ull * 1024 * 1024)
+
+class GeometryPool;
+
+// Range of one of the pool's buffers, in elements of the stride it was allocated with so it can be
+// passed straight to vkCmdDrawIndexed as vertexOffset or firstIndex
+struct GeometryRange
+{
+	GeometryPool*	pool = nullptr;
+	// The pool's vertex or index buffer, what uploads copy into
+	VkBuffer		buffer = VK_NULL_HANDLE;
+	VkDeviceSize	offset = 0;
+	VkDeviceSize	size = 0;
+	uint32_t		first = 0;
+	uint32_t		node = UINT32_MAX;
+
+	inline bool IsValid() const { return pool != nullptr; }
+};
+
+// Geometry of every mesh in one device local vertex buffer and one index buffer, bound once per pass.
+// Ranges are sub-allocated with a TlsfHeap and start on a multiple of their stride, whatever the vertex
+// format or index type, so draws only differ by vertexOffset and firstIndex. Thread safe.
+class GeometryPool
+{
+public:
+	GeometryPool() = default;
+	~GeometryPool() = default;
+
+	void Create(Context context, VkDeviceSize vertexSize = GEOMETRY_VERTEX_POOL_SIZE, VkDeviceSize indexSize = GEOMETRY_INDEX_POOL_SIZE);
+	// Every range must have been freed
+	void Destroy(VkDevice device);
+
+	// Throws when the pool is full. Filled through the staging ring, which only hands the range over.
+	GeometryRange AllocateVertices(uint32_t count, uint32_t stride);
+	GeometryRange AllocateIndices(uint32_t count, uint32_t stride);
+	// The range must not be in use by the device anymore
+	void Free(GeometryRange& range);
+
+	inline VkBuffer GetVertexBuffer() { return _vertexBuffer.GetBuffer(); }
+	inline VkBuffer GetIndexBuffer() { return _indexBuffer.GetBuffer(); }
+
+private:
+	std::mutex		_mutex;
+	Buffer			_vertexBuffer;
+	Buffer			_indexBuffer;
+	TlsfHeap		_vertexHeap;
+	TlsfHeap		_indexHeap;
+
+	GeometryRange Allocate(TlsfHeap& heap, VkBuffer buffer, uint32_t count, uint32_t stride);
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+inline uint64_t HashMix(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return x;
+}
+
+inline uint64_t HashRotate(uint64_t x, int bits)
+{
+	return (x << bits) | (x >> (64 - bits));
+}
+
+// 64-bit hash of a byte range, four independent lanes so large inputs are not
+// bound by a single multiply chain
+inline uint64_t Hash64(const void* data, size_t size, uint64_t seed = 0)
+{
+	const uint64_t prime = 0x9e3779b97f4a7c15ULL;
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+	uint64_t lanes[4] = { seed + prime, seed ^ 0x5bd1e9955bd1e995ULL, seed - prime, seed ^ 0x27d4eb2f165667c5ULL };
+	size_t i = 0;
+
+	for (; i + 32 <= size; i += 32)
+	{
+		for (int lane = 0; lane < 4; ++lane)
+		{
+			uint64_t word;
+			memcpy(&word, bytes + i + lane * 8, sizeof(word));
+			lanes[lane] = HashRotate(lanes[lane] ^ (word * prime), 31) * 0xc2b2ae3d27d4eb4fULL;
+		}
+	}
+
+	uint64_t hash = HashRotate(lanes[0], 1) + HashRotate(lanes[1], 7) + HashRotate(lanes[2], 12) + HashRotate(lanes[3], 18);
+	hash ^= static_cast<uint64_t>(size) * prime;
+
+	for (; i + 8 <= size; i += 8)
+	{
+		uint64_t word;
+		memcpy(&word, bytes + i, sizeof(word));
+		hash = HashRotate(hash ^ HashMix(word), 27) * prime;
+	}
+
+	uint64_t tail = 0;
+	for (size_t shift = 0; i < size; ++i, shift += 8)
+		tail |= static_cast<uint64_t>(bytes[i]) << shift;
+
+	return HashMix(hash ^ HashMix(tail + prime));
+}
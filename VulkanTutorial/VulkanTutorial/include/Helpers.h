@@ -2,12 +2,89 @@
 
 #include <vulkan/vulkan.h>
 #include <stdexcept>
+#include <vector>
 #include "Context.h"#
 
-uint32_t FindMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties);
 void CreateImage(Context context, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage,
-	VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
-VkImageView CreateImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
+	VkMemoryPropertyFlags properties, VkImage& image, MemoryAllocation& imageMemory, uint32_t mipLevels = 1);
+VkImageView CreateImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels = 1);
 bool HasStencilComponent(VkFormat format);
-void TransitionImageLayout(Context context, VkImage image,
-	VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
+// How a resource is used between two barriers, GetResourceStateInfo gives the stages, accesses and
+// image layout of each use
+enum ResourceState
+{
+	RESOURCE_STATE_UNDEFINED,
+	RESOURCE_STATE_TRANSFER_SRC,
+	RESOURCE_STATE_TRANSFER_DST,
+	RESOURCE_STATE_VERTEX_BUFFER,
+	RESOURCE_STATE_INDEX_BUFFER,
+	RESOURCE_STATE_UNIFORM_BUFFER,
+	RESOURCE_STATE_VERTEX_SHADER_READ,
+	RESOURCE_STATE_FRAGMENT_SHADER_READ,
+	RESOURCE_STATE_DEPTH_ATTACHMENT,
+	// Storage buffer or image read and written by a compute shader
+	RESOURCE_STATE_COMPUTE_SHADER_READ_WRITE,
+	// Indirect draw arguments and counts
+	RESOURCE_STATE_INDIRECT_ARGUMENT,
+	// Read by whatever comes next, for data handed over without knowing its use
+	RESOURCE_STATE_ANY_READ,
+	RESOURCE_STATE_COUNT
+};
+
+struct ResourceStateInfo
+{
+	VkPipelineStageFlags	stages;
+	VkAccessFlags			access;
+	VkImageLayout			layout;
+};
+
+const ResourceStateInfo& GetResourceStateInfo(ResourceState state);
+
+// Which half of a queue family ownership transfer the barriers of a BarrierBatch are
+enum BarrierOwnership
+{
+	BARRIER_OWNERSHIP_NONE,
+	// Recorded on the source family's queue, only makes the writes available
+	BARRIER_OWNERSHIP_RELEASE,
+	// Recorded on the destination family's queue after the release, makes them visible to the new use
+	BARRIER_OWNERSHIP_ACQUIRE
+};
+
+// Collects image, buffer and memory barriers and records them all in one vkCmdPipelineBarrier, the
+// stage and access masks derived from the states on both sides
+class BarrierBatch
+{
+public:
+	BarrierBatch() = default;
+	// Every barrier added is one half of an ownership transfer from srcFamily to dstFamily
+	BarrierBatch(BarrierOwnership ownership, uint32_t srcFamily, uint32_t dstFamily);
+	~BarrierBatch() = default;
+
+	BarrierBatch& AddImage(VkImage image, const VkImageSubresourceRange& range, ResourceState before, ResourceState after);
+	// Every level and layer of the image
+	BarrierBatch& AddImage(VkImage image, VkImageAspectFlags aspect, ResourceState before, ResourceState after);
+	BarrierBatch& AddBuffer(VkBuffer buffer, ResourceState before, ResourceState after, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+	// Every resource written in before
+	BarrierBatch& AddMemory(ResourceState before, ResourceState after);
+
+	// Records the barriers added since the last flush, nothing when there are none
+	void Flush(VkCommandBuffer commandBuffer);
+
+	inline bool IsEmpty() const { return _imageBarriers.empty() && _bufferBarriers.empty() && _memoryBarriers.empty(); }
+
+private:
+	BarrierOwnership					_ownership = BARRIER_OWNERSHIP_NONE;
+	uint32_t							_srcFamily = VK_QUEUE_FAMILY_IGNORED;
+	uint32_t							_dstFamily = VK_QUEUE_FAMILY_IGNORED;
+	VkPipelineStageFlags				_srcStages = 0;
+	VkPipelineStageFlags				_dstStages = 0;
+	std::vector<VkImageMemoryBarrier>	_imageBarriers;
+	std::vector<VkBufferMemoryBarrier>	_bufferBarriers;
+	std::vector<VkMemoryBarrier>		_memoryBarriers;
+
+	// Accumulates the stages of both states and returns the access masks for them
+	void AddStates(ResourceState before, ResourceState after, VkAccessFlags& srcAccess, VkAccessFlags& dstAccess);
+};
+
+// One barrier on every level of image in a one time command buffer, waits for it
+void TransitionImageLayout(Context context, VkImage image, VkImageAspectFlags aspect, ResourceState before, ResourceState after);
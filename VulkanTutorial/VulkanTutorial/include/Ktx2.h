@@ -0,0 +1,52 @@
+#pragma once
+
+#include "MappedFile.h"
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define KTX2_EXTENSION ".ktx2"
+
+// Read side of a KTX2 container, limited to what textures here need: a single 2D image (no
+// layers, faces or depth) without supercompression. The file stays mapped while open.
+class Ktx2File
+{
+public:
+	Ktx2File() = default;
+	~Ktx2File() = default;
+
+	// false when the file is missing, is not a KTX2 file of the supported subset, is not in a block
+	// format GetBlockFormat knows or has levels that are not exactly the size of their blocks
+	bool Open(const char* file);
+	void Close();
+
+	inline VkFormat GetFormat() const { return _format; }
+	inline uint32_t GetWidth() const { return _width; }
+	inline uint32_t GetHeight() const { return _height; }
+	inline uint32_t GetLevelCount() const { return static_cast<uint32_t>(_levels.size()); }
+	// Level 0 is the full resolution image
+	const unsigned char* GetLevelData(uint32_t level, uint64_t& size) const;
+
+	// Path of the compressed copy of a source image: same name, .ktx2 extension
+	static std::string GetPath(const char* sourceFile);
+	// levels[0] is the full resolution image, each level holds blockSize bytes per 4x4 block
+	static void Write(const char* file, VkFormat format, uint32_t blockSize, uint32_t width, uint32_t height,
+		const std::vector<std::vector<unsigned char>>& levels);
+
+private:
+	struct Level
+	{
+		uint64_t	offset;
+		uint64_t	size;
+	};
+
+	MappedFile						_file;
+	VkFormat						_format = VK_FORMAT_UNDEFINED;
+	uint32_t						_width = 0;
+	uint32_t						_height = 0;
+	std::vector<Level>				_levels;
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile() = default;
+
+	bool Open(const char* file);
+	void Close();
+
+	inline bool IsOpen() const { return _data != nullptr; }
+	inline const unsigned char* GetData() const { return _data; }
+	inline size_t GetSize() const { return _size; }
+
+private:
+	const unsigned char*			_data = nullptr;
+	size_t							_size = 0;
+#ifdef _WIN32
+	void*							_file = nullptr;
+	void*							_mapping = nullptr;
+#endif
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Slot of a material map that has no texture, the shader skips it
+#define MATERIAL_NO_TEXTURE UINT32_MAX
+
+enum MaterialTexture
+{
+	MATERIAL_TEXTURE_BASE_COLOR,
+	MATERIAL_TEXTURE_EMISSIVE,
+	MATERIAL_TEXTURE_COUNT
+};
+
+// Source files of a material's maps, empty for the maps it does not have
+struct MaterialFiles
+{
+	std::string		textures[MATERIAL_TEXTURE_COUNT];
+};
+
+// Material storage buffer entry (a uvec4 in the shaders): slots in the bindless texture array
+struct MaterialData
+{
+	uint32_t	textures[MATERIAL_TEXTURE_COUNT];
+	uint32_t	padding[4 - MATERIAL_TEXTURE_COUNT];
+};
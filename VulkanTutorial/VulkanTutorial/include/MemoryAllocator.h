@@ -0,0 +1,149 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Size of the device memory blocks resources are sub-allocated from, smaller on small heaps
+#define MEMORY_BLOCK_SIZE (64ull * 1024 * 1024)
+// Heaps smaller than this get blocks of an eighth of their size
+#define MEMORY_SMALL_HEAP_SIZE (1024ull * 1024 * 1024)
+// Resources larger than this fraction of a block get their own allocation
+#define MEMORY_DEDICATED_FRACTION 2
+
+// Two level segregated fit allocator over an abstract range of size bytes (Masmano et al. 2004).
+// Free ranges are binned by size class, allocation and free are O(1) and neighbouring free ranges
+// are always merged. Only offsets are managed, MemoryAllocator maps them to device memory.
+class TlsfHeap
+{
+public:
+	TlsfHeap() = default;
+	~TlsfHeap() = default;
+
+	void Create(VkDeviceSize size);
+
+	// Returns a node id and the aligned offset, UINT32_MAX when no free range fits
+	uint32_t Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+	void Free(uint32_t node);
+
+	inline VkDeviceSize GetSize() const { return _size; }
+	inline VkDeviceSize GetUsedBytes() const { return _usedBytes; }
+	inline bool IsEmpty() const { return _usedBytes == 0; }
+
+private:
+	static const uint32_t NO_NODE = UINT32_MAX;
+	// Sizes are split into 2^SECOND_LEVEL_BITS classes between powers of two
+	static const uint32_t SECOND_LEVEL_BITS = 3;
+	static const uint32_t SECOND_LEVEL_COUNT = 1 << SECOND_LEVEL_BITS;
+	// Sizes below 2^SMALL_SIZE_BITS share the first level 0, split linearly
+	static const uint32_t SMALL_SIZE_BITS = 8;
+	static const uint32_t FIRST_LEVEL_COUNT = 64 - SMALL_SIZE_BITS + 1;
+
+	// Contiguous range of the heap, linked to its physical neighbours and, when free, to the
+	// other free ranges of its size class
+	struct Node
+	{
+		VkDeviceSize	offset;
+		VkDeviceSize	size;
+		uint32_t		previous;
+		uint32_t		next;
+		uint32_t		previousFree;
+		uint32_t		nextFree;
+		bool			free;
+	};
+
+	std::vector<Node>		_nodes;
+	std::vector<uint32_t>	_unusedNodes;
+	uint64_t				_firstLevelMap = 0;
+	uint32_t				_secondLevelMap[FIRST_LEVEL_COUNT] = {};
+	uint32_t				_freeLists[FIRST_LEVEL_COUNT][SECOND_LEVEL_COUNT];
+	VkDeviceSize			_size = 0;
+	VkDeviceSize			_usedBytes = 0;
+
+	uint32_t NewNode();
+	void InsertFree(uint32_t node);
+	void RemoveFree(uint32_t node);
+	// Splits the tail past size off node as a new free node
+	void Split(uint32_t node, VkDeviceSize size);
+	// Absorbs next into node, next must follow node
+	void Merge(uint32_t node, uint32_t next);
+
+	static void GetClass(VkDeviceSize size, uint32_t& firstLevel, uint32_t& secondLevel);
+};
+
+struct MemoryBlock;
+class MemoryAllocator;
+
+// Memory bound to one resource, either a range of a shared block or a dedicated allocation
+struct MemoryAllocation
+{
+	MemoryAllocator*	allocator = nullptr;
+	VkDeviceMemory		memory = VK_NULL_HANDLE;
+	VkDeviceSize		offset = 0;
+	VkDeviceSize		size = 0;
+	// Host visible memory stays mapped for its whole life, null otherwise
+	void*				mapped = nullptr;
+	uint32_t			memoryType = 0;
+	// Null for dedicated allocations
+	MemoryBlock*		block = nullptr;
+	uint32_t			node = UINT32_MAX;
+
+	inline bool IsValid() const { return memory != VK_NULL_HANDLE; }
+};
+
+struct MemoryStatistics
+{
+	uint32_t		blockCount = 0;
+	uint32_t		dedicatedCount = 0;
+	uint32_t		allocationCount = 0;
+	// Bytes handed out to resources and bytes of device memory allocated for them
+	VkDeviceSize	usedBytes = 0;
+	VkDeviceSize	reservedBytes = 0;
+};
+
+// Device memory for buffers and images. Small resources share large per memory type blocks, which
+// keeps the vkAllocateMemory count far below maxMemoryAllocationCount, large ones or those the driver
+// prefers dedicated get their own allocation. Linear and optimal tiling resources use separate blocks
+// whenever bufferImageGranularity could make them alias a page. Thread safe.
+class MemoryAllocator
+{
+public:
+	MemoryAllocator() = default;
+	~MemoryAllocator() = default;
+
+	void Create(VkPhysicalDevice physicalDevice, VkDevice device);
+	// Every allocation must have been freed
+	void Destroy();
+
+	// Allocates memory for the resource and binds it, throws when no memory fits
+	MemoryAllocation AllocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties);
+	MemoryAllocation AllocateForImage(VkImage image, VkMemoryPropertyFlags properties, bool linearTiling = false);
+	void Free(MemoryAllocation& allocation);
+	// Makes host writes to the range (relative to the allocation) visible to the device. Nothing to do on
+	// coherent memory, on other memory the range is widened to nonCoherentAtomSize.
+	void Flush(const MemoryAllocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+	MemoryStatistics GetStatistics();
+
+	uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+
+private:
+	VkDevice							_device = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties	_memoryProperties = {};
+	VkDeviceSize						_bufferImageGranularity = 1;
+	VkDeviceSize						_nonCoherentAtomSize = 1;
+	std::mutex							_mutex;
+	// Blocks by pool, two pools per memory type: linear resources and optimal tiling images
+	std::vector<std::vector<MemoryBlock*>>	_pools;
+	uint32_t							_dedicatedCount = 0;
+	uint32_t							_allocationCount = 0;
+	VkDeviceSize						_dedicatedBytes = 0;
+
+	MemoryAllocation Allocate(const VkMemoryRequirements& requirements, bool dedicated, VkBuffer buffer, VkImage image,
+		VkMemoryPropertyFlags properties, bool optimalImage);
+	MemoryAllocation AllocateDedicated(const VkMemoryRequirements& requirements, uint32_t memoryType, VkBuffer buffer, VkImage image);
+	VkDeviceSize GetBlockSize(uint32_t memoryType) const;
+	void* Map(VkDeviceMemory memory, uint32_t memoryType);
+};
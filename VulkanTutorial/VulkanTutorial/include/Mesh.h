@@ -2,10 +2,44 @@
 
 #include "Context.h"
 #include "Vertex.h"
-#include "Texture.h"
+#include "TextureManager.h"
+#include "Material.h"
 #include "CommandPool.h"
+#include "Bounds.h"
+#include "MeshCache.h"
+#include "Meshlet.h"
+#include "GeometryPool.h"
 
 #define MODEL_PATH "Media/cube.obj"
+#define MAX_UINT16_INDEXED_VERTICES 65536
+#define MESH_MAX_LODS 5
+// A LOD is kept only if it has at most this fraction of the previous LOD's triangles
+#define MESH_LOD_MIN_REDUCTION 0.85f
+
+// Index range of one level of detail, every LOD indexes the same vertex buffer
+struct MeshLod
+{
+	uint32_t	firstIndex;
+	uint32_t	indexCount;
+	// Estimate of the object space distance to the full resolution surface: the sum of the RMS plane
+	// distance of every simplification step down to this LOD (see SimplifyMesh), not a strict bound
+	float		error;
+	uint32_t	padding;
+};
+
+struct MeshLoadSettings
+{
+	// Vertices closer than this (same grid cell) with matching attributes are merged, 0 welds exact matches only
+	float weldTolerance = 0.0f;
+	// Reorder triangles for the post-transform cache and overdraw, then vertices for fetch locality
+	bool optimize = true;
+	// Layout of the vertex buffer, packed vertices are dequantized in the vertex shader with GetPositionScale/Offset
+	VertexFormat vertexFormat = VERTEX_FORMAT_FLOAT;
+	// Levels of detail including the full resolution one, each aiming at half the previous triangles
+	uint32_t lodCount = 4;
+
+	uint64_t GetHash() const;
+};
 
 class Mesh
 {
@@ -13,35 +47,72 @@ public:
 	Mesh() = default;
 	~Mesh() = default;
 
-	Mesh& LoadMesh(const char* modelFile, const char* textureFile = "");
+	// Textures are loaded separately through TextureManager and set with SetTexture
+	Mesh& LoadGeometry(const char* modelFile, const MeshLoadSettings& settings = MeshLoadSettings());
 
+	// Vertices and indices go to ranges of context.geometry, the copies are recorded into context.staging
+	// and the geometry is usable once the batch completed
+	void CreateGeometryBuffers(Context context);
 	void CreateVertexBuffer(Context context);
-	void CreateBuffers(Context context);
 	void CreateIndexBuffer(Context context);
+	void CreateMeshletBuffer(Context context);
 
 	void Destroy(VkDevice device);
 
-	inline VkPipelineVertexInputStateCreateInfo& GetInfo() { return _info; };
+	inline VertexFormat GetVertexFormat() const { return _vertexFormat; }
+	// 16-bit indices whenever every vertex is addressable with them
+	inline VkIndexType GetIndexType() const { return _indexType; }
+	inline uint32_t GetIndexStride() const { return _indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t); }
+	// Maps the vertex buffer positions back to object space: offset + position * scale
+	glm::vec3 GetPositionScale() const;
+	glm::vec3 GetPositionOffset() const;
 
-	inline const VkBuffer& GetVertexBuffer() { return _vertexBuffer.GetBuffer(); }
-	inline const VkBuffer& GetIndexBuffer() { return _indexBuffer.GetBuffer(); }
-	inline const uint32_t& GetIndexSize() { return static_cast<uint32_t>(_indices.size()); }
-	inline VkImageView& GetTextureView() { return _texture.GetView(); }
-	inline VkSampler& GetTextureSampler() { return _texture.GetSampler(); }
-	inline std::vector<VkDescriptorSet>& GetDescriptorBuffer() { return _descriptorSets; }
-	inline std::vector<Buffer>& GetUniformBuffer() { return _uniformBuffers; }
+	// Where the mesh starts in the geometry pool buffers: vertexOffset and the firstIndex every LOD is relative to
+	inline int32_t GetVertexOffset() const { return static_cast<int32_t>(_vertexRange.first); }
+	inline uint32_t GetFirstIndex() const { return _indexRange.first; }
+	// Storage buffer of Meshlet, indexing the index buffer
+	inline const VkBuffer& GetMeshletBuffer() { return _meshletBuffer.GetBuffer(); }
+	inline const Meshlet* GetMeshlets() const { return _meshletData; }
+	inline uint32_t GetMeshletCount() const { return _meshletCount; }
+	inline const uint32_t& GetIndexSize() { return _indexCount; }
+	inline const MeshLod& GetLod(uint32_t lod) const { return _lodData[lod]; }
+	inline uint32_t GetLodCount() const { return _lodCount; }
+	inline const Bounds& GetBounds() const { return _bounds; }
+	// References held by the mesh, released by whoever destroys it. Invalid for the maps its material lacks.
+	inline TextureHandle GetTexture(MaterialTexture map = MATERIAL_TEXTURE_BASE_COLOR) const { return _textures[map]; }
+	inline void SetTexture(MaterialTexture map, TextureHandle texture) { _textures[map] = texture; }
 
 private:
 	std::vector<Vertex>				_vertices;
 	std::vector<uint32_t>			_indices;
-	Buffer							_vertexBuffer;
-	Buffer							_indexBuffer;
-	Texture							_texture;
-	std::vector<VkDescriptorSet>	_descriptorSets;
-	std::vector<Buffer>				_uniformBuffers;
-
-	VkPipelineVertexInputStateCreateInfo				_info;
-	VkVertexInputBindingDescription						_bindingDescriptor;
-	std::array<VkVertexInputAttributeDescription, 3>	_attributeDescriptions;
+	std::vector<PackedVertex>		_packedVertices;
+	std::vector<uint16_t>			_indices16;
+	std::vector<Meshlet>			_meshlets;
+	std::vector<MeshLod>			_lods;
+	MeshCache						_cache;
+	const void*						_vertexData = nullptr;
+	const void*						_indexData = nullptr;
+	const Meshlet*					_meshletData = nullptr;
+	const MeshLod*					_lodData = nullptr;
+	uint32_t						_vertexCount = 0;
+	uint32_t						_indexCount = 0;
+	uint32_t						_meshletCount = 0;
+	uint32_t						_lodCount = 0;
+	VertexFormat					_vertexFormat = VERTEX_FORMAT_FLOAT;
+	VkIndexType						_indexType = VK_INDEX_TYPE_UINT32;
+	Bounds							_bounds;
+	GeometryRange					_vertexRange;
+	GeometryRange					_indexRange;
+	Buffer							_meshletBuffer;
+	TextureHandle					_textures[MATERIAL_TEXTURE_COUNT];
+
+	void LoadObj(const char* modelFile, const MeshLoadSettings& settings);
+	bool LoadCache(const char* modelFile, const MeshLoadSettings& settings);
+	void WriteCache(const char* modelFile, const MeshLoadSettings& settings);
+	void Optimize(const char* modelFile);
+	void BuildLods(const MeshLoadSettings& settings);
+	void Pack();
+
+	static VkIndexType ChooseIndexType(uint32_t vertexCount);
 
 };
\ No newline at end of file
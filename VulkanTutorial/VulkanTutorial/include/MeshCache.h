@@ -0,0 +1,59 @@
+#pragma once
+
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Bump whenever the layout of a section or of the data it holds changes
+#define MESH_CACHE_VERSION 6
+#define MESH_CACHE_EXTENSION ".meshcache"
+
+class MeshCache
+{
+public:
+	enum SectionId : uint32_t
+	{
+		// Vertices in the mesh vertex format, indices in the type the vertex count allows
+		SECTION_VERTICES = 0,
+		SECTION_INDICES,
+		SECTION_BOUNDS,
+		SECTION_MESHLETS,
+		SECTION_LODS,
+	};
+
+	struct Section
+	{
+		uint32_t	id;
+		const void*	data;
+		uint64_t	size;
+	};
+
+	MeshCache() = default;
+	~MeshCache() = default;
+
+	// Maps the cache stored next to sourceFile, returns false if it is missing or stale.
+	// settingsHash identifies the load settings the cached data was built with.
+	bool Open(const char* sourceFile, uint32_t vertexStride, uint64_t settingsHash);
+	void Close();
+
+	static void Write(const char* sourceFile, uint32_t vertexStride, uint64_t settingsHash, const std::vector<Section>& sections);
+	static std::string GetCachePath(const char* sourceFile);
+
+	inline bool IsOpen() const { return _file.IsOpen(); }
+
+	const void* GetSection(uint32_t id, uint64_t& size) const;
+
+	template<typename T>
+	const T* GetSection(uint32_t id, uint32_t& count) const
+	{
+		uint64_t size = 0;
+		const void* data = GetSection(id, size);
+		count = static_cast<uint32_t>(size / sizeof(T));
+		return static_cast<const T*>(data);
+	}
+
+private:
+	MappedFile						_file;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Vertex.h"
+
+#include <cstdint>
+#include <vector>
+
+#define VERTEX_CACHE_SIZE 16
+#define OVERDRAW_THRESHOLD 1.05f
+
+struct VertexCacheStatistics
+{
+	// Average cache miss ratio (misses per triangle) and average transformed to vertex ratio
+	// (misses per referenced vertex), both on a simulated FIFO cache
+	float acmr;
+	float atvr;
+};
+
+VertexCacheStatistics AnalyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+// Tipsify triangle order (Sander et al. 2007). When clusters is not null it receives the first
+// triangle of every run that started after a cache flush, which is what OptimizeOverdraw sorts.
+void OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize = VERTEX_CACHE_SIZE,
+	std::vector<uint32_t>* clusters = nullptr);
+
+// Splits the clusters further where it costs at most threshold times the cache efficiency, then
+// orders them so outward facing clusters on the outside of the mesh are drawn first
+void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& clusters,
+	uint32_t cacheSize = VERTEX_CACHE_SIZE, float threshold = OVERDRAW_THRESHOLD);
+
+// Reorders vertices by first use in the index buffer and drops unreferenced ones
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "Vertex.h"
+
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+// Quadric error edge collapse (Garland & Heckbert 1997) that only moves vertices onto existing
+// ones, so the result indexes the same vertex buffer. Vertices on borders, on attribute seams
+// (several vertices at one position) and on non manifold edges are kept where they are.
+// Writes at least targetIndexCount indices when the error bound or topology stops it earlier
+// and returns the square root of the largest collapse error, an area weighted mean of squared plane
+// distances: an object space RMS distance, not a bound on the deviation.
+float SimplifyMesh(std::vector<uint32_t>& destination, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+	size_t targetIndexCount, float maxError = FLT_MAX);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Vertex.h"
+
+#include <cstdint>
+#include <vector>
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+// A run of consecutive triangles of the mesh index buffer with its culling data, laid out to
+// match the std430 storage buffer the shaders read. Everything is in object space.
+struct Meshlet
+{
+	// Bounding sphere center in xyz, radius in w
+	glm::vec4	sphere;
+	glm::vec4	aabbMin;
+	glm::vec4	aabbMax;
+	// Normal cone apex in xyz. The whole meshlet faces away from a camera at position p when
+	// dot(normalize(apex - p), coneAxis.xyz) >= coneAxis.w, a cutoff of 1 never culls.
+	glm::vec4	coneApex;
+	glm::vec4	coneAxis;
+
+	uint32_t	firstIndex;
+	uint32_t	indexCount;
+	uint32_t	vertexCount;
+	uint32_t	padding;
+};
+
+// Splits the index buffer, in its current order, into meshlets of at most maxVertices unique
+// vertices and maxTriangles triangles. The index buffer is left untouched so an optimized
+// order keeps both its cache efficiency and compact meshlets.
+void BuildMeshlets(std::vector<Meshlet>& meshlets, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+	uint32_t maxVertices = MESHLET_MAX_VERTICES, uint32_t maxTriangles = MESHLET_MAX_TRIANGLES);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct MipLevel
+{
+	size_t		offset;
+	uint32_t	width;
+	uint32_t	height;
+};
+
+// floor(log2(max(width, height))) + 1, the length of a full chain down to 1x1
+uint32_t GetMipLevelCount(uint32_t width, uint32_t height);
+
+// Builds the full RGBA8 mip chain of an image on the CPU with a 2x2 box filter (SSE2 when
+// available, rows split over the thread pool). output receives every level back to back,
+// level 0 included, and levels their offsets and sizes.
+void GenerateMipChain(const unsigned char* pixels, uint32_t width, uint32_t height,
+	std::vector<unsigned char>& output, std::vector<MipLevel>& levels);
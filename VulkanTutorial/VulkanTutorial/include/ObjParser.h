@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ObjIndex
+{
+	int vertex;
+	int normal;
+	int texCoord;
+};
+
+struct ObjShape
+{
+	std::string	name;
+	uint32_t	firstIndex;
+	uint32_t	indexCount;
+};
+
+// Wavefront OBJ reader for triangle meshes: the file is memory mapped, split into
+// line aligned chunks and every chunk is parsed on the thread pool
+class ObjParser
+{
+public:
+	ObjParser() = default;
+	~ObjParser() = default;
+
+	ObjParser& Parse(const char* file);
+
+	// Three floats per position and normal, two per texture coordinate
+	inline const std::vector<float>& GetPositions() const { return _positions; }
+	inline const std::vector<float>& GetNormals() const { return _normals; }
+	inline const std::vector<float>& GetTexCoords() const { return _texCoords; }
+
+	// Triangulated corners, zero based, -1 when the attribute is absent
+	inline const std::vector<ObjIndex>& GetIndices() const { return _indices; }
+	inline const std::vector<ObjShape>& GetShapes() const { return _shapes; }
+
+private:
+	std::vector<float>				_positions;
+	std::vector<float>				_normals;
+	std::vector<float>				_texCoords;
+	std::vector<ObjIndex>			_indices;
+	std::vector<ObjShape>			_shapes;
+};
+
+#ifdef OBJ_PARSER_BENCHMARK
+// Times tinyobj against ObjParser on the same file and prints the results
+int RunObjParserBenchmark(const char* file, int iterations);
+#endif
@@ -8,6 +8,8 @@ struct QueueFamilyIndices
 {
 	std::optional<uint32_t> graphicsFamily;
 	std::optional<uint32_t> presentFamily;
+	// Transfer only family, the copy engine of most discrete GPUs, copies there run alongside rendering
+	std::optional<uint32_t> transferFamily;
 
 	bool isComplete()
 	{
@@ -25,19 +27,23 @@ struct QueueFamilyIndices
 		int i = 0;
 		for (const auto& queueFamily : queueFamilies)
 		{
-			if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+			if (!isComplete())
 			{
-				graphicsFamily = i;
-			}
+				if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+				{
+					graphicsFamily = i;
+				}
 
-			VkBool32 presentSupport = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+				VkBool32 presentSupport = false;
+				vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
 
-			if (presentSupport)
-				presentFamily = i;
+				if (presentSupport)
+					presentFamily = i;
+			}
 
-			if (isComplete())
-				break;
+			if (!transferFamily.has_value() && (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+				!(queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+				transferFamily = i;
 
 			i++;
 		}
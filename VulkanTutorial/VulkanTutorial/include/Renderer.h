@@ -10,6 +10,9 @@
 
 #include "Camera.h"
 #include "Mesh.h"
+#include "AssetLoader.h"
+#include "Frustum.h"
+#include "SphereCuller.h"
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <chrono>
@@ -17,16 +20,78 @@
 #define WIDTH 800
 #define HEIGHT 600
 #define MAX_FRAMES_IN_FLIGHT 2
+// Initial capacity of the per object buffers, doubled whenever the scene outgrows it
+#define OBJECT_INITIAL_CAPACITY 64
+// Size of the bindless texture array, texture handle id + 1 is the slot and slot 0 is the placeholder
+#define MAX_BINDLESS_TEXTURES 1024
+#define PLACEHOLDER_TEXTURE_SLOT 0
+#define FIELD_OF_VIEW 45.0f
+#define NEAR_PLANE 0.1f
+#define FAR_PLANE 100.0f
+// Largest projected LOD error allowed on screen, in pixels
+#define LOD_PIXEL_ERROR 1.0f
+// Fraction of LOD_PIXEL_ERROR a coarser LOD must stay under before switching to it
+#define LOD_HYSTERESIS 0.25f
+
+// Draws recorded per secondary command buffer, smaller lists are recorded by one task
+#define RECORD_DRAWS_PER_TASK 256
+// Indirect draws are grouped by pipeline and index type, one indirect count draw each. Group g owns
+// the object capacity's worth of commands from g * capacity and the count at g.
+#define DRAW_GROUP_COUNT (VERTEX_FORMAT_COUNT * 2)
+// Local size of cull.comp
+#define CULL_GROUP_SIZE 64
 
 #define TEXTURE_PATH "Media/chalet.jpg"
 
-struct UniformBufferObject
+struct FrameUniforms
 {
-	glm::mat4 model;
 	glm::mat4 view;
 	glm::mat4 proj;
 };
 
+// Object storage buffer entry, indexed by gl_InstanceIndex: every draw is one instance whose
+// firstInstance is its object. Materials are filled in the same order.
+struct ObjectData
+{
+	glm::mat4 model;
+	// Dequantization of packed vertex positions, xyz used
+	glm::vec4 positionScale;
+	glm::vec4 positionOffset;
+};
+
+
+// Cull pass input, one per object of the draw list (std430, matches cull.comp)
+struct CullObject
+{
+	// Object space bounding sphere, radius in w
+	glm::vec4 sphere;
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	uint32_t objectIndex;
+	uint32_t group;
+	uint32_t padding[3];
+};
+
+// Push constants of the cull pass
+struct CullConstants
+{
+	// World space frustum
+	glm::vec4 planes[6];
+	uint32_t objectCount;
+	// Commands each draw group owns, the object capacity
+	uint32_t drawsPerGroup;
+};
+
+// Commands of one frame in flight, recorded every frame into pools reset once the frame's fence signalled
+struct FrameCommands
+{
+	CommandPool						pool;
+	VkCommandBuffer					commandBuffer;
+	// One pool per recording task, a task only records into its own pool's buffer so tasks never share a pool
+	std::vector<CommandPool>		recordPools;
+	std::vector<VkCommandBuffer>	secondaryCommandBuffers;
+};
 
 namespace Application
 {
@@ -36,6 +101,13 @@ namespace Application
 		Context							_context;
 		InputManager					_inputManager;
 		std::vector<Mesh*>				_meshes;
+		TextureManager					_textureManager;
+		AssetLoader						_assetLoader;
+		Texture							_placeholderTexture;
+		// Per swapchain image, texture slots to rewrite before the image is drawn again and the slots
+		// holding a texture. Slots are update after bind, writing one does not invalidate the command buffer.
+		std::vector<std::vector<uint32_t>>	_staleTextureSlots;
+		std::vector<std::vector<bool>>		_writtenTextureSlots;
 		float							_lastFrame;
 		float							_currentFrameTime;
 		GLFWwindow*						_window;
@@ -47,17 +119,42 @@ namespace Application
 		VkRenderPass					_renderPass;
 		VkDescriptorSetLayout			_descriptorSetLayout;
 		VkPipelineLayout				_pipelineLayout;
-		VkPipeline						_graphicsPipeline;
-		std::vector<VkCommandBuffer>	_commandBuffers;
+		// One pipeline per vertex format, the format is also a specialization constant of shader.vert
+		std::array<VkPipeline, VERTEX_FORMAT_COUNT>	_graphicsPipelines;
+		std::vector<FrameCommands>		_frameCommands;
+		// Indices in _meshes of what this frame draws, in draw order
+		std::vector<uint32_t>			_drawList;
+		// World bounding sphere of each mesh, culled on the CPU when there is no GPU culling
+		SphereCuller					_culler;
+		// LOD drawn for each mesh
+		std::vector<uint32_t>			_meshLods;
 		std::vector<VkSemaphore>		_imageAvailableSemaphores;
 		std::vector<VkSemaphore>		_renderFinishedSemaphores;
 		std::vector<VkFence>			_inFlightFences;
 		std::vector<VkFence>			_imagesInFlight;
 		size_t							_currentFrame = 0;
+		// Frames drawn so far, what retired streamed textures are timed against
+		uint64_t						_frameCount = 0;
 		std::vector<VkFramebuffer>		_swapChainFramebuffers;
 		VkDescriptorPool				_descriptorPool;
+		// Per swapchain image: one set bound once per frame and the buffers it points to
+		std::vector<VkDescriptorSet>	_descriptorSets;
+		std::vector<Buffer>				_frameUniformBuffers;
+		std::vector<Buffer>				_objectBuffers;
+		std::vector<Buffer>				_materialBuffers;
+		// Per swapchain image, VkDrawIndexedIndirectCommand and draw counts of every draw group, written by the
+		// cull pass from the draw list in the cull object buffer
+		std::vector<Buffer>				_drawCommandBuffers;
+		std::vector<Buffer>				_drawCountBuffers;
+		std::vector<Buffer>				_cullObjectBuffers;
+		// Objects the object, material, cull object and draw command buffers hold
+		uint32_t						_objectCapacity = OBJECT_INITIAL_CAPACITY;
+		VkDescriptorSetLayout			_cullSetLayout;
+		VkPipelineLayout				_cullPipelineLayout;
+		VkPipeline						_cullPipeline;
+		std::vector<VkDescriptorSet>	_cullDescriptorSets;
 		VkImage							_depthImage;
-		VkDeviceMemory					_depthImageMemory;
+		MemoryAllocation				_depthImageMemory;
 		VkImageView						_depthImageView;
 		std::vector<Shader>				_shaders;
 
@@ -75,6 +172,8 @@ namespace Application
 		void CreateRenderPass();
 		void CreateDescriptorSetLayout();
 		void CreateGraphicsPipeline();
+		void CreateCullPipeline();
+		void DestroyCullPipeline();
 		void CreateFramebuffers();
 		VkFormat FindSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 		VkFormat FindDepthFormat();
@@ -83,7 +182,39 @@ namespace Application
 		void CreateUniformBuffers();
 		void CreateDescriptorPool();
 		void CreateDescriptorSets();
-		void CreateCommandBuffers();
+		// The buffers sized by _objectCapacity and their descriptors in both sets
+		void CreateObjectBuffers();
+		void DestroyObjectBuffers();
+		void WriteObjectDescriptors();
+		// Waits for the device and reallocates the object buffers when count objects do not fit
+		void GrowObjectBuffers(size_t count);
+		// Queues the texture's slot for a rewrite in every image's set
+		void MarkTextureStale(TextureHandle texture);
+		void UpdateTextureSlots(uint32_t imageIndex);
+		// Slot of the texture in the image's set, MATERIAL_NO_TEXTURE until it has been written there
+		uint32_t GetTextureSlot(TextureHandle texture, uint32_t imageIndex) const;
+		void CreatePlaceholderTexture();
+		void RequestScene();
+		void AcceptLoadedAssets();
+		void CreateFrameCommands();
+		void DestroyFrameCommands();
+		// Every mesh for the cull pass, or the meshes in the view frustum without it
+		void BuildDrawList();
+		// Records the current frame: the render pass into the primary buffer, the draw list split across
+		// tasks into secondary ones
+		void RecordCommandBuffer(uint32_t imageIndex);
+		void RecordDraws(VkCommandBuffer commandBuffer, uint32_t imageIndex, size_t firstDraw, size_t lastDraw);
+		// Compute pass turning the draw list into the visible draws of every draw group
+		void RecordCulling(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+		// One indirect count draw per draw group whatever the number of objects
+		void RecordIndirectDraws(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+		void WriteCullObjects(uint32_t imageIndex);
+		glm::mat4 GetProjectionMatrix() const;
+		// Every mesh shares this one transform, there is no per-mesh placement yet
+		glm::mat4 GetModelMatrix() const;
+		void SelectLods();
+		// Requests texture resolutions from on-screen sizes and applies the streaming changes
+		void StreamTextures();
 		void CreateSyncObjects();
 		SwapChainSupportDetails QuerySwapChainSupport(VkPhysicalDevice device);
 		VkSurfaceFormatKHR ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Frustum.h"
+
+#include <cstdint>
+#include <vector>
+
+// Spheres tested by one task, a multiple of every SIMD width
+#define CULL_SPHERES_PER_TASK 16384
+
+// World space bounding spheres kept as structure of arrays, one array per component, so a frustum
+// test handles 4 spheres per instruction with SSE and 8 with AVX2. Large sets are split across the
+// thread pool. Externally synchronized.
+class SphereCuller
+{
+public:
+	SphereCuller() = default;
+	~SphereCuller() = default;
+
+	// New spheres are never visible until set
+	void Resize(size_t count);
+	void Set(size_t index, const glm::vec3& center, float radius);
+	inline size_t GetCount() const { return _count; }
+
+	// Replaces visible with the indices of the spheres intersecting the frustum, in increasing order
+	void Cull(const Frustum& frustum, std::vector<uint32_t>& visible);
+
+private:
+	// Padded to a multiple of 8, padding spheres have a radius of -FLT_MAX and are always culled
+	std::vector<float>					_centerX;
+	std::vector<float>					_centerY;
+	std::vector<float>					_centerZ;
+	std::vector<float>					_radius;
+	size_t								_count = 0;
+	// Output of each task, kept between calls so culling does not allocate
+	std::vector<std::vector<uint32_t>>	_taskVisible;
+
+	// Writes the visible indices of [first, last) to visible and returns how many there are,
+	// visible has room for the whole range
+	size_t CullRange(const Frustum& frustum, size_t first, size_t last, uint32_t* visible) const;
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "Buffer.h"
+#include "Helpers.h"
+#include "MipGenerator.h"
+
+#include <deque>
+#include <vector>
+
+// Host visible staging memory uploads are copied through, reused once the copies completed
+#define STAGING_RING_SIZE (64ull * 1024 * 1024)
+// Upload bytes a thread starts per frame, streaming leaves the rest for the following frames
+#define STAGING_FRAME_BUDGET (8ull * 1024 * 1024)
+// Offset of every staged range: a multiple of 4 for buffer copies and of every texel block size
+#define STAGING_ALIGNMENT 16
+
+// Uploads through one persistently mapped ring buffer. Data is copied into the ring right away and
+// its transfer recorded into a shared command buffer, submitted as one batch with a fence. Space
+// is reclaimed when the batch completed, a full ring waits on the oldest batch.
+//
+// Copies are collected and recorded together, the layout transitions of every image they write in
+// one barrier before them and every transition or release after them in one barrier after, whenever
+// a command buffer is fetched or the batch submitted.
+//
+// When the device has a transfer only queue family the copies run on its queue alongside rendering.
+// The batch then releases what it wrote to the graphics family and a second command buffer acquires
+// it on the graphics queue, waiting on a semaphore the copies signal. That part is only submitted
+// once the copies finished (see Reclaim), so it never holds the graphics queue up. Without one, both
+// parts are the same command buffer on the graphics queue.
+//
+// Resources are only usable once IsComplete returns true for the batch that wrote them.
+// Externally synchronized: every thread that uploads owns a ring.
+class StagingRing
+{
+public:
+	StagingRing() = default;
+	~StagingRing() = default;
+
+	void Create(Context context, VkDeviceSize size = STAGING_RING_SIZE);
+	// Submits what is recorded and waits for every batch
+	void Destroy();
+
+	// Records a copy of size bytes of data into dst and hands the range to the graphics queue, data can be freed on return
+	void CopyToBuffer(const void* data, VkDeviceSize size, VkBuffer dst, VkDeviceSize dstOffset = 0);
+	// One region per level, levels[i] at its offset in data goes to mip level i. The image is new,
+	// its mipLevels levels are moved from UNDEFINED to TRANSFER_DST_OPTIMAL first.
+	void CopyToImage(const void* data, VkDeviceSize size, VkImage image, uint32_t mipLevels, const std::vector<MipLevel>& levels);
+	// Moves every level of an image written by CopyToImage to state and hands it to the graphics queue.
+	// state is RESOURCE_STATE_FRAGMENT_SHADER_READ, or RESOURCE_STATE_TRANSFER_DST to blit more levels
+	// with GetGraphicsCommandBuffer.
+	void FinishImage(VkImage image, uint32_t mipLevels, ResourceState state);
+	// Command buffers of the batch being recorded, with every collected copy and barrier recorded:
+	// transfer for more transfers, graphics for what comes after FinishImage. Fetch them again after
+	// every copy, making room may have submitted the previous batch.
+	VkCommandBuffer GetTransferCommandBuffer();
+	VkCommandBuffer GetGraphicsCommandBuffer();
+
+	// Submits the batch being recorded and returns its id, or the last submitted one when nothing is recorded
+	uint64_t Submit();
+	// Batch the next recorded commands go to
+	inline uint64_t GetCurrentBatch() const { return _isRecording ? _recording.id : _nextBatch; }
+	inline bool IsComplete(uint64_t batch) const { return batch <= _completedBatch; }
+	// Blocks until the batch and every batch before it completed
+	void Wait(uint64_t batch);
+	void Flush();
+	// Submits the graphics part of the batches whose copies finished and frees the space of the
+	// completed ones, once per frame keeps uploads moving without waiting
+	void Reclaim();
+
+	// Starts a new frame budget
+	inline void BeginFrame() { _frameBytes = 0; }
+	// Whether size more bytes fit in this frame's budget, the first upload of a frame always does
+	// so a level larger than the budget still gets through
+	inline bool FitsFrameBudget(VkDeviceSize size) const { return _frameBytes == 0 || _frameBytes + size <= STAGING_FRAME_BUDGET; }
+
+private:
+	struct Batch
+	{
+		// The same command buffer when there is no transfer family
+		VkCommandBuffer		transferCommands = VK_NULL_HANDLE;
+		VkCommandBuffer		graphicsCommands = VK_NULL_HANDLE;
+		// Transfer family only: the copies finished, and the semaphore the graphics part waits on
+		VkFence				transferFence = VK_NULL_HANDLE;
+		VkSemaphore			semaphore = VK_NULL_HANDLE;
+		VkFence				fence = VK_NULL_HANDLE;
+		uint64_t			id = 0;
+		bool				graphicsSubmitted = false;
+		// Ring position past the batch's last range
+		VkDeviceSize		end = 0;
+		// Data larger than the ring is staged in its own buffer, destroyed with the batch
+		std::vector<Buffer>	overflow;
+	};
+
+	VkDevice				_device = VK_NULL_HANDLE;
+	VkQueue					_graphicsQueue = VK_NULL_HANDLE;
+	VkQueue					_transferQueue = VK_NULL_HANDLE;
+	uint32_t				_graphicsFamily = 0;
+	uint32_t				_transferFamily = 0;
+	// Whether copies run on their own family and need ownership transfers
+	bool					_ownershipTransfer = false;
+	std::mutex*				_queueMutex = nullptr;
+	MemoryAllocator*		_allocator = nullptr;
+	CommandPool				_graphicsPool;
+	CommandPool				_transferPool;
+	Buffer					_buffer;
+	unsigned char*			_data = nullptr;
+	VkDeviceSize			_size = 0;
+	// Positions grow forever, the ring offset is position % _size. Everything before _tail is free.
+	VkDeviceSize			_head = 0;
+	VkDeviceSize			_tail = 0;
+	Batch					_recording;
+	bool					_isRecording = false;
+	std::deque<Batch>		_pending;
+	std::vector<Batch>		_freeBatches;
+	uint64_t				_nextBatch = 1;
+	uint64_t				_submittedBatch = 0;
+	uint64_t				_completedBatch = 0;
+	VkDeviceSize			_frameBytes = 0;
+	// Collected for the batch being recorded, see RecordCopies
+	struct ImageCopy
+	{
+		VkBuffer		source;
+		VkImage			image;
+		uint32_t		firstRegion;
+		uint32_t		regionCount;
+	};
+	struct BufferCopy
+	{
+		VkBuffer		source;
+		VkBuffer		dst;
+		VkBufferCopy	region;
+	};
+	std::vector<BufferCopy>			_bufferCopies;
+	std::vector<ImageCopy>			_imageCopies;
+	std::vector<VkBufferImageCopy>	_imageRegions;
+	BarrierBatch					_copyBarriers;
+	// Transitions after the copies, releases when there is a transfer family
+	BarrierBatch					_releaseBarriers;
+	BarrierBatch					_acquireBarriers;
+
+	void BeginBatch();
+	// Records the collected copies and their barriers into the batch being recorded
+	void RecordCopies();
+	Batch CreateBatch();
+	void DestroyBatch(Batch& batch);
+	// Copies data into the ring, or an overflow buffer, and returns where it went
+	VkDeviceSize Stage(const void* data, VkDeviceSize size, VkBuffer& buffer);
+	void SubmitGraphics(Batch& batch);
+	void WaitOldest();
+	void Retire(Batch& batch);
+};
@@ -1,6 +1,23 @@
 #pragma once
 
-#include "Buffer.h"
+#include "StagingRing.h"
+#include "MipGenerator.h"
+
+#include <vector>
+
+#define TEXTURE_FORMAT VK_FORMAT_R8G8B8A8_UNORM
+
+// Every level of a texture kept in system memory, what streaming uploads resident levels from
+struct TextureMipSource
+{
+	VkFormat					format = TEXTURE_FORMAT;
+	std::vector<unsigned char>	data;
+	// Level 0 is the full resolution image
+	std::vector<MipLevel>		levels;
+
+	// Bytes of the levels from baseLevel to the last one
+	VkDeviceSize GetSize(uint32_t baseLevel) const;
+};
 
 class Texture
 {
@@ -8,23 +25,60 @@ public:
 	Texture() = default;
 	~Texture() = default;
 
-	void Load(const char* file);
+	// With a physical device, a precompressed .ktx2 next to file is used instead when the device
+	// can sample its format, otherwise file is decoded to RGBA8
+	void Load(const char* file, VkPhysicalDevice physicalDevice = VK_NULL_HANDLE);
+	// Moves the decoded levels out, building the mip chain of decoded pixels. false when there is nothing.
+	bool TakeMipSource(TextureMipSource& source);
+	// Image and view holding only the levels from baseLevel down, baseLevel becomes mip 0.
+	// Uploads are recorded into context.staging, the image is usable once the batch completed.
+	void UploadLevels(Context context, const TextureMipSource& source, uint32_t baseLevel);
+	// Drops decoded data that will not be uploaded
+	void FreePixels();
+	// Copies width * height RGBA8 pixels, used for generated textures such as placeholders
+	void LoadPixels(const unsigned char* pixels, int width, int height);
+	// Upload and a sampler owned by this texture
 	void CreateTexture(Context context);
-	void CopyBufferToImage(Context context, Buffer buffer, VkImage image, uint32_t width, uint32_t height);
+	// Image and view only, the sampler is set separately (shared samplers from TextureManager)
+	void Upload(Context context);
+	// Records blits filling levels 1 and up from level 0, leaves every level shader readable
+	void GenerateMipmaps(VkCommandBuffer commandBuffer);
 	void CreateTextureImageView(VkDevice device);
 	void CreateTextureSampler(VkDevice device);
+	// How this texture is sampled, CreateTextureSampler creates exactly this
+	VkSamplerCreateInfo GetSamplerInfo() const;
+	inline void SetSampler(VkSampler sampler) { _textureSampler = sampler; }
 
 	void Destroy(VkDevice device);
+	// Destroy without the sampler, for textures whose sampler is shared
+	void DestroyImage(VkDevice device);
 
-	inline VkImageView& GetView() { return _textureImageView; }
-	inline VkSampler& GetSampler() { return _textureSampler; }
+	inline VkImageView GetView() const { return _textureImageView; }
+	inline VkSampler GetSampler() const { return _textureSampler; }
+	inline int GetWidth() const { return _texWidth; }
+	inline int GetHeight() const { return _texHeight; }
+	inline bool IsCompressed() const { return _format != TEXTURE_FORMAT; }
+	inline uint32_t GetMipLevels() const { return _mipLevels; }
+	inline VkFormat GetFormat() const { return _format; }
+	inline bool IsCreated() const { return _textureImageView != VK_NULL_HANDLE; }
 
 private:
-	VkImage							_textureImage;
-	VkDeviceMemory					_textureImageMemory;
-	VkImageView						_textureImageView;
-	VkSampler						_textureSampler;
-	unsigned char*					_pixels;
-	int								_texWidth;
-	int								_texHeight;
+	VkImage							_textureImage = VK_NULL_HANDLE;
+	MemoryAllocation				_textureImageMemory;
+	VkImageView						_textureImageView = VK_NULL_HANDLE;
+	VkSampler						_textureSampler = VK_NULL_HANDLE;
+	unsigned char*					_pixels = nullptr;
+	int								_texWidth = 0;
+	int								_texHeight = 0;
+	uint32_t						_mipLevels = 1;
+	VkFormat						_format = TEXTURE_FORMAT;
+	// Block compressed levels read from a KTX2 file, uploaded as they are
+	std::vector<unsigned char>		_compressedData;
+	std::vector<MipLevel>			_compressedLevels;
+
+	bool LoadKtx2(const char* file, VkPhysicalDevice physicalDevice);
+	void UploadCompressed(Context context);
+
+	static bool SupportsLinearBlit(VkPhysicalDevice physicalDevice, VkFormat format);
+	static bool SupportsSampling(VkPhysicalDevice physicalDevice, VkFormat format);
 };
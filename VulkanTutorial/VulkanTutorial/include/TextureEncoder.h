@@ -0,0 +1,10 @@
+#pragma once
+
+#include "BlockCompression.h"
+
+// Offline conversion of a PNG/JPG image to a block compressed KTX2 file next to it with the full
+// mip chain. Texture::Load picks that file up instead of the source when the device supports it.
+void EncodeTexture(const char* sourceFile, BlockFormat format);
+
+// Command line entry: <bc1|bc3|bc5|bc7> <image>..., prints the result of every file
+int RunTextureEncoder(int argc, char** argv);
@@ -0,0 +1,187 @@
+#pragma once
+
+#include "Texture.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define TEXTURE_HANDLE_INVALID UINT32_MAX
+
+// GPU memory streamed textures may use, their base levels included
+#define TEXTURE_STREAMING_BUDGET (256ull * 1024 * 1024)
+// Levels up to this size are resident as soon as a streamed texture is published and never evicted
+#define TEXTURE_STREAMING_BASE_SIZE 128
+
+struct TextureHandle
+{
+	uint32_t	id = TEXTURE_HANDLE_INVALID;
+
+	inline bool IsValid() const { return id != TEXTURE_HANDLE_INVALID; }
+};
+
+struct TextureLoadSettings
+{
+	// Use the precompressed KTX2 next to the source when the device can sample it
+	bool					allowCompressed = true;
+	VkSamplerAddressMode	addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	bool					anisotropy = true;
+
+	uint64_t GetHash() const;
+};
+
+struct TextureDecodeResult
+{
+	Texture			texture;
+	double			milliseconds = 0.0;
+	// Empty when the decode succeeded
+	std::string		error;
+};
+
+// Textures shared by canonical path and load settings: every user of the same file gets the same
+// image and view and holds a reference on it. Samplers are shared by their create info and live
+// as long as the manager. Safe to use from the loader and render threads at the same time.
+class TextureManager
+{
+public:
+	TextureManager() = default;
+	~TextureManager() = default;
+
+	void Create(VkPhysicalDevice physicalDevice);
+	void Destroy(VkDevice device);
+
+	// Takes a reference on the texture for file and settings. Returns true when the caller created
+	// the entry and must Publish (or Abandon) it, false when it already exists: then it is either
+	// resident or being loaded by someone else, see WaitReady.
+	bool Acquire(const std::string& file, const TextureLoadSettings& settings, TextureHandle& handle);
+	// Texture::Load honoring the settings, thread safe
+	void Decode(const std::string& file, const TextureLoadSettings& settings, Texture& texture) const;
+	// Uploads a texture decoded with Decode for an entry returned by Acquire, waits for the upload
+	void Publish(Context context, TextureHandle handle, Texture& texture);
+	// Publish for decoded results[k] of files[k] acquired as handles[k], all uploaded in one staging
+	// batch. Failed decodes are abandoned, failed uploads reported.
+	void PublishBatch(Context context, const std::vector<TextureHandle>& handles, std::vector<TextureDecodeResult>& results,
+		const std::vector<std::string>& files);
+	// The load failed, the entry is dropped from the cache so the next Acquire tries again
+	void Abandon(TextureHandle handle);
+	// Blocks until the entry is resident, false if its load failed
+	bool WaitReady(TextureHandle handle);
+
+	// Decodes every file concurrently on the thread pool, results[i] receives files[i]. Results are
+	// sized before the workers start and each one fills its own slot, a failed file only sets its error.
+	void DecodeBatch(const std::vector<std::string>& files, const TextureLoadSettings& settings, std::vector<TextureDecodeResult>& results) const;
+	static void PrintDecodeResults(const std::vector<std::string>& files, const std::vector<TextureDecodeResult>& results, double totalMilliseconds);
+
+	// Acquire, decode, upload and wait in one call on the calling thread
+	TextureHandle Load(Context context, const std::string& file, const TextureLoadSettings& settings = TextureLoadSettings());
+	// Load for many files, the new ones decoded with DecodeBatch. Failed files get an invalid handle.
+	std::vector<TextureHandle> LoadBatch(Context context, const std::vector<std::string>& files, const TextureLoadSettings& settings = TextureLoadSettings());
+
+	void AddRef(TextureHandle handle);
+	void Release(TextureHandle handle);
+	// Destroys the textures without references, the caller makes sure the GPU no longer uses them
+	void DestroyUnused(VkDevice device);
+
+	bool IsReady(TextureHandle handle);
+	// Only valid once the texture is ready, the reference stays valid while a reference is held
+	const Texture& GetTexture(TextureHandle handle);
+	VkSampler GetSampler(VkDevice device, const VkSamplerCreateInfo& info);
+
+	// Textures published from now on keep their levels in system memory and start with only the
+	// levels up to TEXTURE_STREAMING_BASE_SIZE resident
+	void EnableStreaming(VkDeviceSize budget = TEXTURE_STREAMING_BUDGET);
+	inline void SetStreamingBudget(VkDeviceSize budget) { _streamingBudget = budget; }
+	VkDeviceSize GetResidentBytes();
+	// Size in pixels the texture covers on screen this frame, the largest request of the frame wins
+	void RequestResolution(TextureHandle handle, float pixels);
+	// Moves requested textures one level finer within the frame budget of context.staging, and evicts
+	// the finest level of the least recently requested textures while over budget. New images are
+	// recorded into context.staging and replace the old ones in a later call, once their batch completed.
+	// Textures whose image changed are appended to changed, their previous image stays alive until
+	// CollectGarbage reaches retireFrame.
+	void UpdateStreaming(Context context, uint64_t frame, uint64_t retireFrame, std::vector<TextureHandle>& changed);
+	void CollectGarbage(VkDevice device, uint64_t frame);
+
+	static std::string GetCanonicalPath(const std::string& file);
+
+private:
+	enum EntryState
+	{
+		ENTRY_LOADING,
+		ENTRY_READY,
+		ENTRY_FAILED
+	};
+
+	struct Entry
+	{
+		std::string				key;
+		TextureLoadSettings		settings;
+		Texture					texture;
+		uint32_t				refCount = 0;
+		EntryState				state = ENTRY_LOADING;
+		// Streaming, source is empty for textures published with every level resident
+		TextureMipSource		source;
+		uint32_t				residentLevel = 0;
+		uint32_t				baseLevel = 0;
+		uint32_t				requestedLevel = UINT32_MAX;
+		uint32_t				targetLevel = 0;
+		uint64_t				lastRequestFrame = 0;
+		// Image for pendingLevel being uploaded by staging batch pendingBatch, 0 when none
+		Texture					pendingTexture;
+		uint32_t				pendingLevel = 0;
+		uint64_t				pendingBatch = 0;
+	};
+
+	struct RetiredTexture
+	{
+		Texture		texture;
+		uint64_t	frame;
+	};
+
+	// Every VkSamplerCreateInfo field after pNext
+	struct SamplerKey
+	{
+		uint32_t	words[16];
+
+		bool operator==(const SamplerKey& other) const;
+	};
+
+	struct SamplerKeyHash
+	{
+		size_t operator()(const SamplerKey& key) const;
+	};
+
+	VkPhysicalDevice				_physicalDevice = VK_NULL_HANDLE;
+	std::mutex						_mutex;
+	std::condition_variable			_readyCondition;
+	// Entries never move, freed slots are reused through _freeEntries
+	std::deque<Entry>				_entries;
+	std::vector<uint32_t>			_freeEntries;
+	std::unordered_map<std::string, uint32_t>					_entryIds;
+	std::unordered_map<SamplerKey, VkSampler, SamplerKeyHash>	_samplers;
+	bool							_streaming = false;
+	VkDeviceSize					_streamingBudget = TEXTURE_STREAMING_BUDGET;
+	VkDeviceSize					_residentBytes = 0;
+	std::vector<RetiredTexture>		_retired;
+
+	// A texture recorded into the staging ring, ready for its entry once the batch completed
+	struct PendingUpload
+	{
+		TextureHandle		handle;
+		Texture				texture;
+		TextureMipSource	source;
+		uint32_t			baseLevel = 0;
+	};
+
+	VkSampler GetSamplerLocked(VkDevice device, const VkSamplerCreateInfo& info);
+	// Abandons the entry and rethrows when the upload fails
+	PendingUpload RecordUpload(Context context, TextureHandle handle, Texture& texture);
+	void CompleteUpload(VkDevice device, PendingUpload& upload);
+	// Uploads an image holding the levels from level down to replace the entry's, false if that failed
+	bool SetResidentLevel(Context context, uint32_t id, uint32_t level);
+	// Least recently requested texture with a level above what it needs, UINT32_MAX when none
+	uint32_t FindEvictionCandidate(uint32_t excluded) const;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+	// threadCount of 0 uses one worker per hardware thread minus the calling thread
+	explicit ThreadPool(uint32_t threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Process wide pool shared by loaders and the renderer
+	static ThreadPool& Get();
+
+	inline uint32_t GetThreadCount() const { return static_cast<uint32_t>(_threads.size()); }
+
+	template<typename F>
+	auto Submit(F&& task) -> std::future<decltype(task())>
+	{
+		using Result = decltype(task());
+		auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+		std::future<Result> future = packaged->get_future();
+
+		Enqueue([packaged]() { (*packaged)(); });
+
+		return future;
+	}
+
+	// Runs func(i) for every i in [0, count), the calling thread takes part in the work
+	// so it is safe to call from inside a pool task
+	void ParallelFor(size_t count, const std::function<void(size_t)>& func);
+
+private:
+	std::vector<std::thread>			_threads;
+	std::queue<std::function<void()>>	_tasks;
+	std::mutex							_mutex;
+	std::condition_variable				_condition;
+	bool								_stop = false;
+
+	void Enqueue(std::function<void()> task);
+	void WorkerLoop();
+};
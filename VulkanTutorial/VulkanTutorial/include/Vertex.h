@@ -10,6 +10,17 @@
 
 #include <array>
 
+#include "Bounds.h"
+
+enum VertexFormat : uint32_t
+{
+	// Vertex: 32-bit float position, normal and texture coordinates
+	VERTEX_FORMAT_FLOAT = 0,
+	// PackedVertex: 16 bytes per vertex, decoded in shader.vert
+	VERTEX_FORMAT_PACKED,
+	VERTEX_FORMAT_COUNT
+};
+
 struct Vertex
 {
 	glm::vec3 pos;
@@ -27,6 +38,23 @@ struct Vertex
 	}
 };
 
+struct PackedVertex
+{
+	uint16_t pos[4];		// unorm16 relative to the mesh bounds, w unused
+	int16_t normal[2];		// octahedral encoded snorm16
+	uint16_t texCoord[2];	// half float
+
+	static VkVertexInputBindingDescription GetBindingDescription();
+
+	static std::array<VkVertexInputAttributeDescription, 3> GetAttributeDescriptions();
+
+	static PackedVertex Pack(const Vertex& vertex, const Bounds& bounds);
+};
+
+uint32_t GetVertexStride(VertexFormat format);
+VkVertexInputBindingDescription GetBindingDescription(VertexFormat format);
+std::array<VkVertexInputAttributeDescription, 3> GetAttributeDescriptions(VertexFormat format);
+
 namespace std
 {
 	template<> struct hash<Vertex>
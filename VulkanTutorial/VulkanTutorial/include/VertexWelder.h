@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Vertex.h"
+#include "ObjParser.h"
+
+#include <vector>
+
+// Builds a deduplicated vertex/index buffer from parsed OBJ corners. Corners are split into
+// ranges welded in parallel with flat open-addressing tables, then a merge pass welds the
+// per-range results together and remaps the indices.
+class VertexWelder
+{
+public:
+	VertexWelder() = default;
+	~VertexWelder() = default;
+
+	// positionTolerance > 0 also merges vertices whose positions fall in the same grid cell
+	// of that size and whose other attributes match, the first vertex seen keeps its position
+	VertexWelder& Weld(const ObjParser& parser, float positionTolerance = 0.0f);
+
+	inline std::vector<Vertex>& GetVertices() { return _vertices; }
+	inline std::vector<uint32_t>& GetIndices() { return _indices; }
+
+private:
+	std::vector<Vertex>				_vertices;
+	std::vector<uint32_t>			_indices;
+};
@@ -0,0 +1,226 @@
+#include "AssetLoader.h"
+#include "QueueFamilyIndices.h"
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <future>
+#include <iterator>
+#include <iostream>
+
+void AssetLoader::Create(Context context, TextureManager* textureManager)
+{
+	_textureManager = textureManager;
+
+	QueueFamilyIndices queueFamilyIndices;
+	queueFamilyIndices.FindQueueFamilies(context.physicalDevice, context.surface);
+
+	// Command pools are externally synchronized, the loader thread gets its own
+	_uploadPool.Create(context.device, queueFamilyIndices.graphicsFamily.value(), VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+	context.commandPool = _uploadPool;
+	_staging.Create(context);
+	context.staging = &_staging;
+
+	_stop = false;
+	_thread = std::thread(&AssetLoader::ThreadMain, this, context);
+}
+
+void AssetLoader::Destroy(VkDevice device)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+		_requests.clear();
+	}
+	_condition.notify_all();
+
+	if (_thread.joinable())
+		_thread.join();
+
+	for (Mesh* mesh : _loadedMeshes)
+	{
+		mesh->Destroy(device);
+		delete mesh;
+	}
+	_loadedMeshes.clear();
+
+	for (LoadedTexture& loaded : _loadedTextures)
+		_textureManager->Release(loaded.texture);
+	_loadedTextures.clear();
+
+	_staging.Destroy();
+	_uploadPool.Destroy(device);
+}
+
+void AssetLoader::RequestMesh(const std::string& modelFile, const MaterialFiles& material, const MeshLoadSettings& settings)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_requests.push_back({ modelFile, material, settings });
+	}
+	_condition.notify_one();
+}
+
+void AssetLoader::TakeMeshes(std::vector<Mesh*>& meshes)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	meshes.insert(meshes.end(), _loadedMeshes.begin(), _loadedMeshes.end());
+	_loadedMeshes.clear();
+}
+
+void AssetLoader::TakeTextures(std::vector<LoadedTexture>& textures)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	textures.insert(textures.end(), _loadedTextures.begin(), _loadedTextures.end());
+	_loadedTextures.clear();
+}
+
+void AssetLoader::WaitIdle()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_idleCondition.wait(lock, [this]() { return _requests.empty() && !_busy; });
+}
+
+void AssetLoader::ThreadMain(Context uploadContext)
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (true)
+	{
+		_condition.wait(lock, [this]() { return _stop || !_requests.empty(); });
+		if (_stop)
+			break;
+
+		std::vector<MeshRequest> requests(std::make_move_iterator(_requests.begin()), std::make_move_iterator(_requests.end()));
+		_requests.clear();
+		_busy = true;
+
+		lock.unlock();
+		try
+		{
+			LoadBatch(uploadContext, requests);
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "asset loader: " << e.what() << std::endl;
+		}
+		lock.lock();
+
+		_busy = false;
+		if (_requests.empty())
+			_idleCondition.notify_all();
+	}
+
+	_busy = false;
+	_idleCondition.notify_all();
+}
+
+void AssetLoader::LoadBatch(Context uploadContext, std::vector<MeshRequest>& requests)
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	const TextureLoadSettings textureSettings;
+
+	// Textures already known to the manager are shared, only the new ones are decoded.
+	// Every material map of every request is one entry, request i map m at i * MATERIAL_TEXTURE_COUNT + m.
+	std::vector<TextureHandle> textures(requests.size() * MATERIAL_TEXTURE_COUNT);
+	std::vector<std::string> decodeFiles;
+	std::vector<size_t> decodeTextures;
+	for (size_t t = 0; t < textures.size(); ++t)
+	{
+		const std::string& file = requests[t / MATERIAL_TEXTURE_COUNT].material.textures[t % MATERIAL_TEXTURE_COUNT];
+		if (!file.empty() && _textureManager->Acquire(file, textureSettings, textures[t]))
+		{
+			decodeFiles.push_back(file);
+			decodeTextures.push_back(t);
+		}
+	}
+
+	std::vector<TextureDecodeResult> decoded;
+	double decodeTime = 0.0;
+	std::future<void> textureDecode = ThreadPool::Get().Submit([&]()
+	{
+		auto start = Clock::now();
+		_textureManager->DecodeBatch(decodeFiles, textureSettings, decoded);
+		decodeTime = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	});
+
+	std::vector<Mesh*> meshes(requests.size(), nullptr);
+	try
+	{
+		for (size_t i = 0; i < requests.size(); ++i)
+		{
+			Mesh* mesh = nullptr;
+			try
+			{
+				mesh = new Mesh;
+				mesh->LoadGeometry(requests[i].modelFile.c_str(), requests[i].settings);
+				mesh->CreateGeometryBuffers(uploadContext);
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << "asset loader: " << requests[i].modelFile << ": " << e.what() << std::endl;
+				if (mesh != nullptr)
+				{
+					// The staging batch may already hold copies into its buffers
+					uploadContext.staging->Flush();
+					mesh->Destroy(uploadContext.device);
+					delete mesh;
+				}
+				continue;
+			}
+
+			meshes[i] = mesh;
+		}
+
+		// All geometry of the batch in one submission, the renderer may destroy a mesh as soon as it has it
+		uploadContext.staging->Flush();
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			for (Mesh* mesh : meshes)
+			{
+				if (mesh != nullptr)
+					_loadedMeshes.push_back(mesh);
+			}
+		}
+	}
+	catch (...)
+	{
+		// The decode task still writes into these locals, and the new entries must not stay loading
+		// or every later Acquire of their files would wait forever
+		textureDecode.wait();
+		for (size_t t : decodeTextures)
+			_textureManager->Abandon(textures[t]);
+		for (TextureHandle texture : textures)
+		{
+			if (texture.IsValid())
+				_textureManager->Release(texture);
+		}
+		throw;
+	}
+
+	// From here the meshes belong to the renderer, textures are handed over on their own
+	textureDecode.get();
+	TextureManager::PrintDecodeResults(decodeFiles, decoded, decodeTime);
+
+	// Publish every new texture before waiting on any, requests sharing a file wait on the first one.
+	// A texture whose mesh failed is still published, it stays cached until DestroyUnused.
+	std::vector<TextureHandle> decodeHandles;
+	for (size_t t : decodeTextures)
+		decodeHandles.push_back(textures[t]);
+	_textureManager->PublishBatch(uploadContext, decodeHandles, decoded, decodeFiles);
+
+	for (size_t t = 0; t < textures.size(); ++t)
+	{
+		if (!textures[t].IsValid())
+			continue;
+
+		Mesh* mesh = meshes[t / MATERIAL_TEXTURE_COUNT];
+		if (mesh == nullptr || !_textureManager->WaitReady(textures[t]))
+		{
+			_textureManager->Release(textures[t]);
+			continue;
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_loadedTextures.push_back({ mesh, static_cast<MaterialTexture>(t % MATERIAL_TEXTURE_COUNT), textures[t] });
+	}
+}
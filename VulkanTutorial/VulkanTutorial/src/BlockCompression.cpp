@@ -0,0 +1,393 @@
+#include "BlockCompression.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	struct Color
+	{
+		float c[4];
+	};
+
+	inline uint16_t PackRgb565(const float rgb[3])
+	{
+		uint32_t r = static_cast<uint32_t>(std::lround(std::min(std::max(rgb[0], 0.0f), 255.0f) * 31.0f / 255.0f));
+		uint32_t g = static_cast<uint32_t>(std::lround(std::min(std::max(rgb[1], 0.0f), 255.0f) * 63.0f / 255.0f));
+		uint32_t b = static_cast<uint32_t>(std::lround(std::min(std::max(rgb[2], 0.0f), 255.0f) * 31.0f / 255.0f));
+
+		return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+	}
+
+	inline void UnpackRgb565(uint16_t color, float rgb[3])
+	{
+		uint32_t r = (color >> 11) & 31;
+		uint32_t g = (color >> 5) & 63;
+		uint32_t b = color & 31;
+
+		rgb[0] = static_cast<float>((r << 3) | (r >> 2));
+		rgb[1] = static_cast<float>((g << 2) | (g >> 4));
+		rgb[2] = static_cast<float>((b << 3) | (b >> 2));
+	}
+
+	// Principal axis of the block colors over the first channelCount channels, by power iteration
+	void PrincipalAxis(const Color* colors, int channelCount, float mean[4], float axis[4])
+	{
+		for (int c = 0; c < 4; ++c)
+			mean[c] = 0.0f;
+		for (int i = 0; i < 16; ++i)
+			for (int c = 0; c < channelCount; ++c)
+				mean[c] += colors[i].c[c] / 16.0f;
+
+		float covariance[4][4] = {};
+		for (int i = 0; i < 16; ++i)
+		{
+			for (int a = 0; a < channelCount; ++a)
+				for (int b = 0; b < channelCount; ++b)
+					covariance[a][b] += (colors[i].c[a] - mean[a]) * (colors[i].c[b] - mean[b]);
+		}
+
+		for (int c = 0; c < 4; ++c)
+			axis[c] = c < channelCount ? 1.0f : 0.0f;
+
+		for (int iteration = 0; iteration < 8; ++iteration)
+		{
+			float next[4] = {};
+			for (int a = 0; a < channelCount; ++a)
+				for (int b = 0; b < channelCount; ++b)
+					next[a] += covariance[a][b] * axis[b];
+
+			float length = 0.0f;
+			for (int c = 0; c < channelCount; ++c)
+				length = std::max(length, std::abs(next[c]));
+			if (length <= 0.0f)
+				break;
+
+			for (int c = 0; c < channelCount; ++c)
+				axis[c] = next[c] / length;
+		}
+	}
+
+	// Endpoints: the extreme block colors along the principal axis
+	void AxisEndpoints(const Color* colors, int channelCount, float minColor[4], float maxColor[4])
+	{
+		float mean[4];
+		float axis[4];
+		PrincipalAxis(colors, channelCount, mean, axis);
+
+		float minT = FLT_MAX;
+		float maxT = -FLT_MAX;
+		for (int i = 0; i < 16; ++i)
+		{
+			float t = 0.0f;
+			for (int c = 0; c < channelCount; ++c)
+				t += (colors[i].c[c] - mean[c]) * axis[c];
+			minT = std::min(minT, t);
+			maxT = std::max(maxT, t);
+		}
+
+		float axisLengthSquared = 0.0f;
+		for (int c = 0; c < channelCount; ++c)
+			axisLengthSquared += axis[c] * axis[c];
+		if (axisLengthSquared <= 0.0f)
+			axisLengthSquared = 1.0f;
+
+		for (int c = 0; c < 4; ++c)
+		{
+			minColor[c] = mean[c] + axis[c] * minT / axisLengthSquared;
+			maxColor[c] = mean[c] + axis[c] * maxT / axisLengthSquared;
+		}
+	}
+
+	void EncodeBC1(const Color* colors, unsigned char* output)
+	{
+		float minColor[4];
+		float maxColor[4];
+		AxisEndpoints(colors, 3, minColor, maxColor);
+
+		uint16_t color0 = PackRgb565(maxColor);
+		uint16_t color1 = PackRgb565(minColor);
+		uint32_t indices = 0;
+
+		if (color0 != color1)
+		{
+			// Four color mode needs color0 > color1
+			if (color0 < color1)
+				std::swap(color0, color1);
+
+			float palette[4][3];
+			UnpackRgb565(color0, palette[0]);
+			UnpackRgb565(color1, palette[1]);
+			for (int c = 0; c < 3; ++c)
+			{
+				palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+				palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+			}
+
+			for (int i = 0; i < 16; ++i)
+			{
+				uint32_t best = 0;
+				float bestDistance = FLT_MAX;
+				for (uint32_t p = 0; p < 4; ++p)
+				{
+					float distance = 0.0f;
+					for (int c = 0; c < 3; ++c)
+						distance += (colors[i].c[c] - palette[p][c]) * (colors[i].c[c] - palette[p][c]);
+					if (distance < bestDistance)
+					{
+						best = p;
+						bestDistance = distance;
+					}
+				}
+				indices |= best << (2 * i);
+			}
+		}
+
+		output[0] = static_cast<unsigned char>(color0);
+		output[1] = static_cast<unsigned char>(color0 >> 8);
+		output[2] = static_cast<unsigned char>(color1);
+		output[3] = static_cast<unsigned char>(color1 >> 8);
+		memcpy(output + 4, &indices, sizeof(indices));
+	}
+
+	void EncodeBC4(const Color* colors, int channel, unsigned char* output)
+	{
+		float minValue = 255.0f;
+		float maxValue = 0.0f;
+		for (int i = 0; i < 16; ++i)
+		{
+			minValue = std::min(minValue, colors[i].c[channel]);
+			maxValue = std::max(maxValue, colors[i].c[channel]);
+		}
+
+		uint32_t a0 = static_cast<uint32_t>(std::lround(maxValue));
+		uint32_t a1 = static_cast<uint32_t>(std::lround(minValue));
+		uint64_t indices = 0;
+
+		// a0 > a1 selects the eight value mode, a0 == a1 decodes index 0 as a0 in both modes
+		if (a0 > a1)
+		{
+			float palette[8];
+			palette[0] = static_cast<float>(a0);
+			palette[1] = static_cast<float>(a1);
+			for (int p = 1; p < 7; ++p)
+				palette[p + 1] = ((7 - p) * palette[0] + p * palette[1]) / 7.0f;
+
+			for (int i = 0; i < 16; ++i)
+			{
+				uint64_t best = 0;
+				float bestDistance = FLT_MAX;
+				for (uint64_t p = 0; p < 8; ++p)
+				{
+					float distance = std::abs(colors[i].c[channel] - palette[p]);
+					if (distance < bestDistance)
+					{
+						best = p;
+						bestDistance = distance;
+					}
+				}
+				indices |= best << (3 * i);
+			}
+		}
+
+		output[0] = static_cast<unsigned char>(a0);
+		output[1] = static_cast<unsigned char>(a1);
+		for (int b = 0; b < 6; ++b)
+			output[2 + b] = static_cast<unsigned char>(indices >> (8 * b));
+	}
+
+	// Writes count bits of value at bit position, LSB first
+	inline void WriteBits(unsigned char* output, uint32_t& position, uint32_t value, uint32_t count)
+	{
+		for (uint32_t b = 0; b < count; ++b, ++position)
+		{
+			if (value & (1u << b))
+				output[position >> 3] |= static_cast<unsigned char>(1u << (position & 7));
+		}
+	}
+
+	// Mode 6: one subset, RGBA endpoints of 7 bits plus a per endpoint p bit, 4-bit indices
+	void EncodeBC7(const Color* colors, unsigned char* output)
+	{
+		static const int WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+		float endpoints[2][4];
+		AxisEndpoints(colors, 4, endpoints[0], endpoints[1]);
+
+		// Quantize each endpoint with whichever p bit reproduces it best
+		uint32_t quantized[2][4];
+		uint32_t pBits[2];
+		int decoded[2][4];
+		for (int e = 0; e < 2; ++e)
+		{
+			float bestError = FLT_MAX;
+			for (uint32_t p = 0; p < 2; ++p)
+			{
+				uint32_t q[4];
+				float error = 0.0f;
+				for (int c = 0; c < 4; ++c)
+				{
+					float value = std::min(std::max(endpoints[e][c], 0.0f), 255.0f);
+					q[c] = static_cast<uint32_t>(std::min(std::max(std::lround((value - p) / 2.0f), 0l), 127l));
+					float reconstructed = static_cast<float>((q[c] << 1) | p);
+					error += (reconstructed - value) * (reconstructed - value);
+				}
+
+				if (error < bestError)
+				{
+					bestError = error;
+					pBits[e] = p;
+					for (int c = 0; c < 4; ++c)
+						quantized[e][c] = q[c];
+				}
+			}
+
+			for (int c = 0; c < 4; ++c)
+				decoded[e][c] = static_cast<int>((quantized[e][c] << 1) | pBits[e]);
+		}
+
+		int palette[16][4];
+		for (int i = 0; i < 16; ++i)
+			for (int c = 0; c < 4; ++c)
+				palette[i][c] = ((64 - WEIGHTS[i]) * decoded[0][c] + WEIGHTS[i] * decoded[1][c] + 32) >> 6;
+
+		uint32_t indices[16];
+		for (int i = 0; i < 16; ++i)
+		{
+			uint32_t best = 0;
+			float bestDistance = FLT_MAX;
+			for (uint32_t p = 0; p < 16; ++p)
+			{
+				float distance = 0.0f;
+				for (int c = 0; c < 4; ++c)
+					distance += (colors[i].c[c] - palette[p][c]) * (colors[i].c[c] - palette[p][c]);
+				if (distance < bestDistance)
+				{
+					best = p;
+					bestDistance = distance;
+				}
+			}
+			indices[i] = best;
+		}
+
+		// The first index is stored without its top bit, swap the endpoints when it is set
+		if (indices[0] & 8)
+		{
+			for (int c = 0; c < 4; ++c)
+				std::swap(quantized[0][c], quantized[1][c]);
+			std::swap(pBits[0], pBits[1]);
+			for (int i = 0; i < 16; ++i)
+				indices[i] = 15 - indices[i];
+		}
+
+		memset(output, 0, 16);
+		uint32_t position = 0;
+		WriteBits(output, position, 1u << 6, 7);
+		for (int c = 0; c < 4; ++c)
+		{
+			WriteBits(output, position, quantized[0][c], 7);
+			WriteBits(output, position, quantized[1][c], 7);
+		}
+		WriteBits(output, position, pBits[0], 1);
+		WriteBits(output, position, pBits[1], 1);
+		WriteBits(output, position, indices[0], 3);
+		for (int i = 1; i < 16; ++i)
+			WriteBits(output, position, indices[i], 4);
+	}
+}
+
+VkFormat GetBlockVkFormat(BlockFormat format)
+{
+	switch (format)
+	{
+	case BLOCK_FORMAT_BC1: return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+	case BLOCK_FORMAT_BC3: return VK_FORMAT_BC3_UNORM_BLOCK;
+	case BLOCK_FORMAT_BC5: return VK_FORMAT_BC5_UNORM_BLOCK;
+	case BLOCK_FORMAT_BC7: return VK_FORMAT_BC7_UNORM_BLOCK;
+	default: return VK_FORMAT_UNDEFINED;
+	}
+}
+
+uint32_t GetBlockSize(BlockFormat format)
+{
+	return format == BLOCK_FORMAT_BC1 ? 8 : 16;
+}
+
+bool GetBlockFormat(VkFormat vkFormat, BlockFormat& format)
+{
+	for (uint32_t i = 0; i < BLOCK_FORMAT_COUNT; ++i)
+	{
+		if (GetBlockVkFormat(static_cast<BlockFormat>(i)) == vkFormat)
+		{
+			format = static_cast<BlockFormat>(i);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool ParseBlockFormat(const char* name, BlockFormat& format)
+{
+	static const char* NAMES[BLOCK_FORMAT_COUNT] = { "bc1", "bc3", "bc5", "bc7" };
+
+	for (uint32_t i = 0; i < BLOCK_FORMAT_COUNT; ++i)
+	{
+		if (strcmp(name, NAMES[i]) == 0)
+		{
+			format = static_cast<BlockFormat>(i);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void CompressImage(const unsigned char* pixels, uint32_t width, uint32_t height, BlockFormat format, std::vector<unsigned char>& output)
+{
+	const uint32_t blocksX = (width + 3) / 4;
+	const uint32_t blocksY = (height + 3) / 4;
+	const uint32_t blockSize = GetBlockSize(format);
+
+	output.resize(static_cast<size_t>(blocksX) * blocksY * blockSize);
+
+	ThreadPool::Get().ParallelFor(blocksY, [&](size_t by)
+	{
+		Color colors[16];
+		for (uint32_t bx = 0; bx < blocksX; ++bx)
+		{
+			for (uint32_t i = 0; i < 16; ++i)
+			{
+				uint32_t x = std::min(bx * 4 + (i & 3), width - 1);
+				uint32_t y = std::min(static_cast<uint32_t>(by) * 4 + (i >> 2), height - 1);
+				const unsigned char* texel = pixels + (static_cast<size_t>(y) * width + x) * 4;
+				for (int c = 0; c < 4; ++c)
+					colors[i].c[c] = static_cast<float>(texel[c]);
+			}
+
+			unsigned char* block = output.data() + (by * blocksX + bx) * blockSize;
+			switch (format)
+			{
+			case BLOCK_FORMAT_BC1:
+				EncodeBC1(colors, block);
+				break;
+			case BLOCK_FORMAT_BC3:
+				EncodeBC4(colors, 3, block);
+				EncodeBC1(colors, block + 8);
+				break;
+			case BLOCK_FORMAT_BC5:
+				EncodeBC4(colors, 0, block);
+				EncodeBC4(colors, 1, block + 8);
+				break;
+			case BLOCK_FORMAT_BC7:
+				EncodeBC7(colors, block);
+				break;
+			default:
+				break;
+			}
+		}
+	});
+}
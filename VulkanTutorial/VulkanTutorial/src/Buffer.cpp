@@ -14,40 +14,29 @@ Buffer& Buffer::CreateBuffer(Context context, VkDeviceSize size, VkBufferUsageFl
 	if (vkCreateBuffer(context.device, &bufferInfo, nullptr, &_buffer) != VK_SUCCESS)
 		throw std::runtime_error("failed to create buffer!");
 
-	VkMemoryRequirements memRequirements;
-	vkGetBufferMemoryRequirements(context.device, _buffer, &memRequirements);
-
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = FindMemoryType(context.physicalDevice, memRequirements.memoryTypeBits, properties);
-
-	if (vkAllocateMemory(context.device, &allocInfo, nullptr, &_bufferMemory) != VK_SUCCESS)
-		throw std::runtime_error("failed to allocate buffer memory!");
+	try
+	{
+		_allocation = context.allocator->AllocateForBuffer(_buffer, properties);
+	}
+	catch (...)
+	{
+		vkDestroyBuffer(context.device, _buffer, nullptr);
+		_buffer = VK_NULL_HANDLE;
+		throw;
+	}
 
-	vkBindBufferMemory(context.device, _buffer, _bufferMemory, 0);
+	return *this;
 }
 
-uint32_t Buffer::FindMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties)
+Buffer& Buffer::CreateMappedBuffer(Context context, VkDeviceSize size, VkBufferUsageFlags usage)
 {
-	VkPhysicalDeviceMemoryProperties memProperties;
-	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-
-	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
-	{
-		if (typeFilter & (1 << i) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
-			return i;
-	}
-
-	throw std::runtime_error("failed to find suitable memory type!");
+	return CreateBuffer(context, size, usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
 }
 
-void Buffer::MapMemory(VkDevice device, VkDeviceSize offset, VkDeviceSize size, VkMemoryMapFlags flags, void* data)
+void Buffer::Flush(VkDeviceSize offset, VkDeviceSize size)
 {
-	void* dataToBind;
-	vkMapMemory(device, _bufferMemory, offset, size, flags, &dataToBind);
-	memcpy(dataToBind, data, (size_t)size);
-	vkUnmapMemory(device, _bufferMemory);
+	if (_allocation.allocator != nullptr)
+		_allocation.allocator->Flush(_allocation, offset, size);
 }
 
 void Buffer::CopyBuffer(Context context, Buffer& dstBuffer, VkDeviceSize size)
@@ -65,5 +54,8 @@ void Buffer::CopyBuffer(Context context, Buffer& dstBuffer, VkDeviceSize size)
 void Buffer::Destroy(VkDevice device)
 {
 	vkDestroyBuffer(device, _buffer, nullptr);
-	vkFreeMemory(device, _bufferMemory, nullptr);
+	_buffer = VK_NULL_HANDLE;
+
+	if (_allocation.allocator != nullptr)
+		_allocation.allocator->Free(_allocation);
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include "Context.h"
 
+#include <stdexcept>
+
 CommandBuffer& CommandBuffer::BeginOneTime(Context context)
 {
 	VkCommandBufferAllocateInfo allocInfo = {};
@@ -29,8 +31,21 @@ void CommandBuffer::EndOneTime(Context context)
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &_buffer;
 
-	vkQueueSubmit(context.graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(context.graphicsQueue);
+	// Wait on a fence rather than the queue so other threads keep submitting meanwhile
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+	VkFence fence;
+	if (vkCreateFence(context.device, &fenceInfo, nullptr, &fence) != VK_SUCCESS)
+		throw std::runtime_error("failed to create one time submit fence!");
+
+	{
+		std::lock_guard<std::mutex> lock(*context.queueMutex);
+		vkQueueSubmit(context.graphicsQueue, 1, &submitInfo, fence);
+	}
+
+	vkWaitForFences(context.device, 1, &fence, VK_TRUE, UINT64_MAX);
+	vkDestroyFence(context.device, fence, nullptr);
 
 	context.commandPool.FreeCommandBuffer(context.device, 1, &_buffer);
 }
\ No newline at end of file
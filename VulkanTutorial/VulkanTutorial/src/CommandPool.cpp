@@ -27,6 +27,12 @@ void CommandPool::FreeCommandBuffer(VkDevice device, uint32_t bufferCount, VkCom
 	vkFreeCommandBuffers(device, _commandPool, bufferCount, commandBuffer);
 }
 
+void CommandPool::Reset(VkDevice device, VkCommandPoolResetFlags flags)
+{
+	if (vkResetCommandPool(device, _commandPool, flags) != VK_SUCCESS)
+		throw std::runtime_error("failed to reset command pool!");
+}
+
 void CommandPool::Destroy(VkDevice device)
 {
 	vkDestroyCommandPool(device, _commandPool, nullptr);
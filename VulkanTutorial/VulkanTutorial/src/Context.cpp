@@ -5,6 +5,8 @@
 #include <iostream>
 
 #include "QueueFamilyIndices.h"
+#include "StagingRing.h"
+#include "GeometryPool.h"
 
 Context& Context::Create(GLFWwindow* window)
 {
@@ -15,6 +17,17 @@ Context& Context::Create(GLFWwindow* window)
 	CreateLogicalDevice();
 	CreateCommandPool();
 
+	allocator = new MemoryAllocator;
+	allocator->Create(physicalDevice, device);
+
+	queueMutex = new std::mutex;
+
+	staging = new StagingRing;
+	staging->Create(*this);
+
+	geometry = new GeometryPool;
+	geometry->Create(*this);
+
 	return *this;
 }
 
@@ -29,7 +42,8 @@ void Context::CreateInstance()
 	appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 	appInfo.pEngineName = "No Engine";
 	appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-	appInfo.apiVersion = VK_API_VERSION_1_0;
+	// 1.1 for vkGetPhysicalDeviceFeatures2 and feature structures chained into the device create info
+	appInfo.apiVersion = VK_API_VERSION_1_1;
 
 	VkInstanceCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -196,6 +210,8 @@ void Context::CreateLogicalDevice()
 
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 	std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+	if (indices.transferFamily.has_value())
+		uniqueQueueFamilies.insert(indices.transferFamily.value());
 	float queuePriority = 1.0f;
 
 	for (uint32_t queueFamily : uniqueQueueFamilies)
@@ -208,8 +224,36 @@ void Context::CreateLogicalDevice()
 		queueCreateInfos.push_back(queueCreateInfo);
 	}
 
-	VkPhysicalDeviceFeatures deviceFeatures = {};
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
+	// Bindless textures: one runtime sized array indexed by material, slots written while bound
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+	indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+	indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+	indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+
+	VkPhysicalDeviceFeatures2 deviceFeatures2 = {};
+	deviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	deviceFeatures2.pNext = &indexingFeatures;
+
+	VkPhysicalDeviceFeatures& deviceFeatures = deviceFeatures2.features;
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
+	deviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+	// BC textures are used when available, Texture falls back to RGBA8 otherwise
+	deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+
+	// Indirect draws select their object with firstInstance, the renderer records every draw itself without them
+	std::vector<const char*> extensions(_deviceExtensions);
+	const bool indirectCount = SupportsExtension(physicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) &&
+		supportedFeatures.multiDrawIndirect && supportedFeatures.drawIndirectFirstInstance;
+	if (indirectCount)
+	{
+		extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+		deviceFeatures.multiDrawIndirect = VK_TRUE;
+		deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+	}
 
 	VkDeviceCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -217,10 +261,12 @@ void Context::CreateLogicalDevice()
 	createInfo.pQueueCreateInfos = queueCreateInfos.data();
 	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());;
 
-	createInfo.pEnabledFeatures = &deviceFeatures;
+	// Features come through the pNext chain, pEnabledFeatures must stay null
+	createInfo.pNext = &deviceFeatures2;
+	createInfo.pEnabledFeatures = nullptr;
 
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(_deviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = _deviceExtensions.data();
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+	createInfo.ppEnabledExtensionNames = extensions.data();
 
 	if (enableValidationLayers)
 	{
@@ -233,8 +279,16 @@ void Context::CreateLogicalDevice()
 	if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS)
 		throw std::runtime_error("failed to create logical device!");
 
+	if (indirectCount)
+		cmdDrawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR");
+
 	vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
 	vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+
+	// Without a transfer only family the copies go to the graphics queue
+	transferQueue = graphicsQueue;
+	if (indices.transferFamily.has_value())
+		vkGetDeviceQueue(device, indices.transferFamily.value(), 0, &transferQueue);
 }
 
 void Context::PickPhysicalDevice()
@@ -294,9 +348,46 @@ int Context::RateDeviceSuitability(VkPhysicalDevice device)
 		return 0;
 	}
 
+	if (!SupportsDescriptorIndexing(device))
+		return 0;
+
 	return score;
 }
 
+bool Context::SupportsExtension(VkPhysicalDevice device, const char* extensionName)
+{
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+	std::vector<VkExtensionProperties> extensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, extensions.data());
+
+	for (const VkExtensionProperties& extension : extensions)
+	{
+		if (strcmp(extension.extensionName, extensionName) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+bool Context::SupportsDescriptorIndexing(VkPhysicalDevice device)
+{
+	if (!SupportsExtension(device, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME))
+		return false;
+
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+	indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+
+	VkPhysicalDeviceFeatures2 features = {};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.pNext = &indexingFeatures;
+	vkGetPhysicalDeviceFeatures2(device, &features);
+
+	return features.features.shaderSampledImageArrayDynamicIndexing && indexingFeatures.runtimeDescriptorArray &&
+		indexingFeatures.descriptorBindingPartiallyBound && indexingFeatures.descriptorBindingSampledImageUpdateAfterBind;
+}
+
 void Context::CreateSurface(GLFWwindow* window)
 {
 	if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS)
@@ -308,13 +399,28 @@ void Context::CreateCommandPool()
 	QueueFamilyIndices queueFamilyIndices;
 	queueFamilyIndices.FindQueueFamilies(physicalDevice, surface);
 
-	commandPool.Create(device, queueFamilyIndices.graphicsFamily.value(), 0);
+	commandPool.Create(device, queueFamilyIndices.graphicsFamily.value(), VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 }
 
 void Context::Destroy()
 {
+	staging->Destroy();
+	delete staging;
+	staging = nullptr;
+
+	geometry->Destroy(device);
+	delete geometry;
+	geometry = nullptr;
+
+	delete queueMutex;
+	queueMutex = nullptr;
+
 	commandPool.Destroy(device);
 
+	allocator->Destroy();
+	delete allocator;
+	allocator = nullptr;
+
 	vkDestroyDevice(device, nullptr);
 
 	if (enableValidationLayers)
@@ -0,0 +1,66 @@
+#include "GeometryPool.h"
+
+#include <numeric>
+#include <stdexcept>
+
+void GeometryPool::Create(Context context, VkDeviceSize vertexSize, VkDeviceSize indexSize)
+{
+	// Exclusive like every other buffer, uploads on a transfer family hand over only the range they wrote
+	_vertexBuffer.CreateBuffer(context, vertexSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	_indexBuffer.CreateBuffer(context, indexSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	_vertexHeap.Create(vertexSize);
+	_indexHeap.Create(indexSize);
+}
+
+void GeometryPool::Destroy(VkDevice device)
+{
+	_indexBuffer.Destroy(device);
+	_vertexBuffer.Destroy(device);
+}
+
+GeometryRange GeometryPool::AllocateVertices(uint32_t count, uint32_t stride)
+{
+	return Allocate(_vertexHeap, _vertexBuffer.GetBuffer(), count, stride);
+}
+
+GeometryRange GeometryPool::AllocateIndices(uint32_t count, uint32_t stride)
+{
+	return Allocate(_indexHeap, _indexBuffer.GetBuffer(), count, stride);
+}
+
+GeometryRange GeometryPool::Allocate(TlsfHeap& heap, VkBuffer buffer, uint32_t count, uint32_t stride)
+{
+	GeometryRange range;
+	range.size = static_cast<VkDeviceSize>(count) * stride;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		// A whole number of elements in, and a multiple of 4 bytes for the staging copy
+		range.node = heap.Allocate(range.size, std::lcm<VkDeviceSize>(stride, 4), range.offset);
+	}
+
+	if (range.node == UINT32_MAX)
+		throw std::runtime_error("geometry pool is full!");
+
+	range.pool = this;
+	range.buffer = buffer;
+	range.first = static_cast<uint32_t>(range.offset / stride);
+
+	return range;
+}
+
+void GeometryPool::Free(GeometryRange& range)
+{
+	if (!range.IsValid())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		(range.buffer == _vertexBuffer.GetBuffer() ? _vertexHeap : _indexHeap).Free(range.node);
+	}
+
+	range = GeometryRange();
+}
@@ -1,22 +1,8 @@
 #include "Helpers.h"
 #include "CommandBuffer.h"
 
-uint32_t FindMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties)
-{
-	VkPhysicalDeviceMemoryProperties memProperties;
-	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-
-	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
-	{
-		if (typeFilter & (1 << i) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
-			return i;
-	}
-
-	throw std::runtime_error("failed to find suitable memory type!");
-}
-
 void CreateImage(Context context, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage,
-	VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory)
+	VkMemoryPropertyFlags properties, VkImage& image, MemoryAllocation& imageMemory, uint32_t mipLevels)
 {
 	VkImageCreateInfo imageInfo = {};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -24,7 +10,7 @@ void CreateImage(Context context, uint32_t width, uint32_t height, VkFormat form
 	imageInfo.extent.width = width;
 	imageInfo.extent.height = height;
 	imageInfo.extent.depth = 1;
-	imageInfo.mipLevels = 1;
+	imageInfo.mipLevels = mipLevels;
 	imageInfo.arrayLayers = 1;
 	imageInfo.format = format;
 	imageInfo.tiling = tiling;
@@ -36,21 +22,19 @@ void CreateImage(Context context, uint32_t width, uint32_t height, VkFormat form
 	if (vkCreateImage(context.device, &imageInfo, nullptr, &image) != VK_SUCCESS)
 		throw std::runtime_error("failed to create image!");
 
-	VkMemoryRequirements memRequirements;
-	vkGetImageMemoryRequirements(context.device, image, &memRequirements);
-
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = FindMemoryType(context.physicalDevice, memRequirements.memoryTypeBits, properties);
-
-	if (vkAllocateMemory(context.device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS)
-		throw std::runtime_error("failed to allocate image memory!");
-
-	vkBindImageMemory(context.device, image, imageMemory, 0);
+	try
+	{
+		imageMemory = context.allocator->AllocateForImage(image, properties, tiling == VK_IMAGE_TILING_LINEAR);
+	}
+	catch (...)
+	{
+		vkDestroyImage(context.device, image, nullptr);
+		image = VK_NULL_HANDLE;
+		throw;
+	}
 }
 
-VkImageView CreateImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags)
+VkImageView CreateImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels)
 {
 	VkImageViewCreateInfo viewInfo = {};
 	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -59,7 +43,7 @@ VkImageView CreateImageView(VkDevice device, VkImage image, VkFormat format, VkI
 	viewInfo.format = format;
 	viewInfo.subresourceRange.aspectMask = aspectFlags;
 	viewInfo.subresourceRange.baseMipLevel = 0;
-	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.levelCount = mipLevels;
 	viewInfo.subresourceRange.baseArrayLayer = 0;
 	viewInfo.subresourceRange.layerCount = 1;
 
@@ -75,74 +59,156 @@ bool HasStencilComponent(VkFormat format)
 	return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
 }
 
-void TransitionImageLayout(Context context, VkImage image,
-	VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout)
+namespace
 {
-	CommandBuffer commandBuffer;
-	commandBuffer.BeginOneTime(context);
+	const ResourceStateInfo resourceStates[RESOURCE_STATE_COUNT] = {
+		// RESOURCE_STATE_UNDEFINED
+		{ VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED },
+		// RESOURCE_STATE_TRANSFER_SRC
+		{ VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL },
+		// RESOURCE_STATE_TRANSFER_DST
+		{ VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL },
+		// RESOURCE_STATE_VERTEX_BUFFER
+		{ VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED },
+		// RESOURCE_STATE_INDEX_BUFFER
+		{ VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED },
+		// RESOURCE_STATE_UNIFORM_BUFFER
+		{ VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_UNIFORM_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED },
+		// RESOURCE_STATE_VERTEX_SHADER_READ
+		{ VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+		// RESOURCE_STATE_FRAGMENT_SHADER_READ
+		{ VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+		// RESOURCE_STATE_DEPTH_ATTACHMENT
+		{ VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL },
+		// RESOURCE_STATE_COMPUTE_SHADER_READ_WRITE
+		{ VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL },
+		// RESOURCE_STATE_INDIRECT_ARGUMENT
+		{ VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED },
+		// RESOURCE_STATE_ANY_READ
+		{ VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED },
+	};
+
+	// Only writes have to be made available, reads before a barrier only need its execution dependency
+	const VkAccessFlags writeAccess = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+}
 
-	VkImageMemoryBarrier barrier = {};
-	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.oldLayout = oldLayout;
-	barrier.newLayout = newLayout;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.image = image;
-	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = 1;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.layerCount = 1;
+const ResourceStateInfo& GetResourceStateInfo(ResourceState state)
+{
+	return resourceStates[state];
+}
 
-	if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
-	{
-		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+BarrierBatch::BarrierBatch(BarrierOwnership ownership, uint32_t srcFamily, uint32_t dstFamily) :
+	_ownership(ownership),
+	_srcFamily(srcFamily),
+	_dstFamily(dstFamily)
+{}
 
-		if (HasStencilComponent(format))
-			barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-	}
-	else
-		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+void BarrierBatch::AddStates(ResourceState before, ResourceState after, VkAccessFlags& srcAccess, VkAccessFlags& dstAccess)
+{
+	const ResourceStateInfo& src = resourceStates[before];
+	const ResourceStateInfo& dst = resourceStates[after];
 
-	VkPipelineStageFlags sourceStage;
-	VkPipelineStageFlags destinationStage;
+	srcAccess = src.access & writeAccess;
+	dstAccess = dst.access;
 
-	if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+	// Each half only synchronizes with its own queue's side of the transfer
+	if (_ownership == BARRIER_OWNERSHIP_RELEASE)
 	{
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		_srcStages |= src.stages;
+		_dstStages |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		dstAccess = 0;
 	}
-	else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+	else if (_ownership == BARRIER_OWNERSHIP_ACQUIRE)
 	{
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-		sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		_srcStages |= VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		_dstStages |= dst.stages;
+		srcAccess = 0;
 	}
-	else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+	else
 	{
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-
-		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		_srcStages |= src.stages;
+		_dstStages |= dst.stages;
 	}
-	else
-		throw std::invalid_argument("unsupported layout transition!");
+}
+
+BarrierBatch& BarrierBatch::AddImage(VkImage image, const VkImageSubresourceRange& range, ResourceState before, ResourceState after)
+{
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	AddStates(before, after, barrier.srcAccessMask, barrier.dstAccessMask);
+	barrier.oldLayout = resourceStates[before].layout;
+	barrier.newLayout = resourceStates[after].layout;
+	barrier.srcQueueFamilyIndex = _srcFamily;
+	barrier.dstQueueFamilyIndex = _dstFamily;
+	barrier.image = image;
+	barrier.subresourceRange = range;
+
+	_imageBarriers.push_back(barrier);
+	return *this;
+}
+
+BarrierBatch& BarrierBatch::AddImage(VkImage image, VkImageAspectFlags aspect, ResourceState before, ResourceState after)
+{
+	VkImageSubresourceRange range = {};
+	range.aspectMask = aspect;
+	range.baseMipLevel = 0;
+	range.levelCount = VK_REMAINING_MIP_LEVELS;
+	range.baseArrayLayer = 0;
+	range.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+	return AddImage(image, range, before, after);
+}
 
+BarrierBatch& BarrierBatch::AddBuffer(VkBuffer buffer, ResourceState before, ResourceState after, VkDeviceSize offset, VkDeviceSize size)
+{
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	AddStates(before, after, barrier.srcAccessMask, barrier.dstAccessMask);
+	barrier.srcQueueFamilyIndex = _srcFamily;
+	barrier.dstQueueFamilyIndex = _dstFamily;
+	barrier.buffer = buffer;
+	barrier.offset = offset;
+	barrier.size = size;
+
+	_bufferBarriers.push_back(barrier);
+	return *this;
+}
+
+BarrierBatch& BarrierBatch::AddMemory(ResourceState before, ResourceState after)
+{
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	AddStates(before, after, barrier.srcAccessMask, barrier.dstAccessMask);
+
+	_memoryBarriers.push_back(barrier);
+	return *this;
+}
+
+void BarrierBatch::Flush(VkCommandBuffer commandBuffer)
+{
+	if (IsEmpty())
+		return;
+
+	vkCmdPipelineBarrier(commandBuffer, _srcStages, _dstStages, 0,
+		static_cast<uint32_t>(_memoryBarriers.size()), _memoryBarriers.data(),
+		static_cast<uint32_t>(_bufferBarriers.size()), _bufferBarriers.data(),
+		static_cast<uint32_t>(_imageBarriers.size()), _imageBarriers.data());
+
+	_memoryBarriers.clear();
+	_bufferBarriers.clear();
+	_imageBarriers.clear();
+	_srcStages = 0;
+	_dstStages = 0;
+}
+
+void TransitionImageLayout(Context context, VkImage image, VkImageAspectFlags aspect, ResourceState before, ResourceState after)
+{
+	CommandBuffer commandBuffer;
+	commandBuffer.BeginOneTime(context);
 
-	vkCmdPipelineBarrier(
-		commandBuffer.Get(),
-		sourceStage, destinationStage,
-		0,
-		0, nullptr,
-		0, nullptr,
-		1, &barrier
-	);
+	BarrierBatch().AddImage(image, aspect, before, after).Flush(commandBuffer.Get());
 
 	commandBuffer.EndOneTime(context);
 }
@@ -0,0 +1,237 @@
+#include "Ktx2.h"
+#include "BlockCompression.h"
+#include "MipGenerator.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+static const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+// Data format descriptor values from the Khronos Data Format specification
+static const uint32_t KHR_DF_MODEL_BC1A = 128;
+static const uint32_t KHR_DF_MODEL_BC3 = 130;
+static const uint32_t KHR_DF_MODEL_BC5 = 132;
+static const uint32_t KHR_DF_MODEL_BC7 = 134;
+static const uint32_t KHR_DF_PRIMARIES_BT709 = 1;
+static const uint32_t KHR_DF_TRANSFER_LINEAR = 1;
+static const uint32_t KHR_DF_VERSION = 2;
+
+struct Ktx2Header
+{
+	unsigned char	identifier[12];
+	uint32_t		vkFormat;
+	uint32_t		typeSize;
+	uint32_t		pixelWidth;
+	uint32_t		pixelHeight;
+	uint32_t		pixelDepth;
+	uint32_t		layerCount;
+	uint32_t		faceCount;
+	uint32_t		levelCount;
+	uint32_t		supercompressionScheme;
+	uint32_t		dfdByteOffset;
+	uint32_t		dfdByteLength;
+	uint32_t		kvdByteOffset;
+	uint32_t		kvdByteLength;
+	uint64_t		sgdByteOffset;
+	uint64_t		sgdByteLength;
+};
+
+struct Ktx2LevelIndex
+{
+	uint64_t		byteOffset;
+	uint64_t		byteLength;
+	uint64_t		uncompressedByteLength;
+};
+
+struct Ktx2Sample
+{
+	uint32_t		channel;
+	uint32_t		bitOffset;
+	uint32_t		bitLength;
+};
+
+// Basic descriptor block: one 4x4 texel block made of 64 or 128 bit samples
+static std::vector<uint32_t> BuildDataFormatDescriptor(BlockFormat format)
+{
+	uint32_t model = KHR_DF_MODEL_BC1A;
+	std::vector<Ktx2Sample> samples;
+
+	switch (format)
+	{
+	case BLOCK_FORMAT_BC1:
+		samples = { { 0, 0, 64 } };
+		break;
+	case BLOCK_FORMAT_BC3:
+		model = KHR_DF_MODEL_BC3;
+		samples = { { 15, 0, 64 }, { 0, 64, 64 } };
+		break;
+	case BLOCK_FORMAT_BC5:
+		model = KHR_DF_MODEL_BC5;
+		samples = { { 0, 0, 64 }, { 1, 64, 64 } };
+		break;
+	default:
+		model = KHR_DF_MODEL_BC7;
+		samples = { { 0, 0, 128 } };
+		break;
+	}
+
+	const uint32_t blockSize = 24 + 16 * static_cast<uint32_t>(samples.size());
+
+	std::vector<uint32_t> words;
+	words.push_back(4 + blockSize);
+	words.push_back(0);
+	words.push_back(KHR_DF_VERSION | (blockSize << 16));
+	words.push_back(model | (KHR_DF_PRIMARIES_BT709 << 8) | (KHR_DF_TRANSFER_LINEAR << 16));
+	words.push_back(3 | (3 << 8));
+	words.push_back(GetBlockSize(format));
+	words.push_back(0);
+
+	for (const Ktx2Sample& sample : samples)
+	{
+		words.push_back(sample.bitOffset | ((sample.bitLength - 1) << 16) | (sample.channel << 24));
+		words.push_back(0);
+		words.push_back(0);
+		words.push_back(UINT32_MAX);
+	}
+
+	return words;
+}
+
+bool Ktx2File::Open(const char* file)
+{
+	Close();
+
+	std::error_code error;
+	if (!std::filesystem::exists(file, error) || !_file.Open(file))
+		return false;
+
+	if (_file.GetSize() < sizeof(Ktx2Header))
+	{
+		Close();
+		return false;
+	}
+
+	const Ktx2Header* header = reinterpret_cast<const Ktx2Header*>(_file.GetData());
+	if (memcmp(header->identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0 || header->supercompressionScheme != 0 ||
+		header->pixelWidth == 0 || header->pixelHeight == 0 || header->pixelDepth != 0 || header->layerCount > 1 ||
+		header->faceCount != 1 || header->vkFormat == VK_FORMAT_UNDEFINED)
+	{
+		Close();
+		return false;
+	}
+
+	// Only the block formats the encoder writes, their size per level is known
+	BlockFormat blockFormat;
+	if (!GetBlockFormat(static_cast<VkFormat>(header->vkFormat), blockFormat))
+	{
+		Close();
+		return false;
+	}
+
+	// A level count of 0 asks the loader to generate mips, which block formats cannot do, so use level 0 only
+	const uint32_t levelCount = header->levelCount > 0 ? header->levelCount : 1;
+	if (levelCount > GetMipLevelCount(header->pixelWidth, header->pixelHeight) ||
+		_file.GetSize() < sizeof(Ktx2Header) + levelCount * sizeof(Ktx2LevelIndex))
+	{
+		Close();
+		return false;
+	}
+
+	// Every level must hold exactly its blocks, the upload copies that many bytes per level
+	const Ktx2LevelIndex* index = reinterpret_cast<const Ktx2LevelIndex*>(_file.GetData() + sizeof(Ktx2Header));
+	for (uint32_t i = 0; i < levelCount; ++i)
+	{
+		const uint64_t width = std::max(header->pixelWidth >> i, 1u);
+		const uint64_t height = std::max(header->pixelHeight >> i, 1u);
+		const uint64_t levelSize = ((width + 3) / 4) * ((height + 3) / 4) * GetBlockSize(blockFormat);
+
+		if (index[i].byteLength != levelSize || index[i].byteOffset > _file.GetSize() ||
+			index[i].byteLength > _file.GetSize() - index[i].byteOffset)
+		{
+			Close();
+			return false;
+		}
+
+		_levels.push_back({ index[i].byteOffset, index[i].byteLength });
+	}
+
+	_format = static_cast<VkFormat>(header->vkFormat);
+	_width = header->pixelWidth;
+	_height = header->pixelHeight;
+
+	return true;
+}
+
+void Ktx2File::Close()
+{
+	_file.Close();
+	_levels.clear();
+	_format = VK_FORMAT_UNDEFINED;
+	_width = 0;
+	_height = 0;
+}
+
+const unsigned char* Ktx2File::GetLevelData(uint32_t level, uint64_t& size) const
+{
+	size = _levels[level].size;
+	return _file.GetData() + _levels[level].offset;
+}
+
+std::string Ktx2File::GetPath(const char* sourceFile)
+{
+	return std::filesystem::path(sourceFile).replace_extension(KTX2_EXTENSION).string();
+}
+
+void Ktx2File::Write(const char* file, VkFormat format, uint32_t blockSize, uint32_t width, uint32_t height,
+	const std::vector<std::vector<unsigned char>>& levels)
+{
+	BlockFormat blockFormat;
+	if (!GetBlockFormat(format, blockFormat))
+		throw std::runtime_error("unsupported KTX2 format");
+
+	const std::vector<uint32_t> dfd = BuildDataFormatDescriptor(blockFormat);
+
+	Ktx2Header header = {};
+	memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+	header.vkFormat = format;
+	header.typeSize = 1;
+	header.pixelWidth = width;
+	header.pixelHeight = height;
+	header.faceCount = 1;
+	header.levelCount = static_cast<uint32_t>(levels.size());
+	header.dfdByteOffset = static_cast<uint32_t>(sizeof(Ktx2Header) + levels.size() * sizeof(Ktx2LevelIndex));
+	header.dfdByteLength = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+
+	// Level data goes smallest level first, each level aligned to the block size
+	std::vector<Ktx2LevelIndex> index(levels.size());
+	uint64_t offset = header.dfdByteOffset + header.dfdByteLength;
+	for (size_t i = levels.size(); i-- > 0;)
+	{
+		offset = (offset + blockSize - 1) / blockSize * blockSize;
+		index[i].byteOffset = offset;
+		index[i].byteLength = levels[i].size();
+		index[i].uncompressedByteLength = levels[i].size();
+		offset += levels[i].size();
+	}
+
+	std::ofstream output(file, std::ios::binary | std::ios::trunc);
+	if (!output.is_open())
+		throw std::runtime_error(std::string("failed to create ") + file);
+
+	output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	output.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(Ktx2LevelIndex));
+	output.write(reinterpret_cast<const char*>(dfd.data()), dfd.size() * sizeof(uint32_t));
+
+	const char zeros[16] = {};
+	for (size_t i = levels.size(); i-- > 0;)
+	{
+		uint64_t position = static_cast<uint64_t>(output.tellp());
+		output.write(zeros, index[i].byteOffset - position);
+		output.write(reinterpret_cast<const char*>(levels[i].data()), levels[i].size());
+	}
+
+	if (!output)
+		throw std::runtime_error(std::string("failed to write ") + file);
+}
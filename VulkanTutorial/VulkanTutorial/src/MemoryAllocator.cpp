@@ -0,0 +1,598 @@
+#include "MemoryAllocator.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+struct MemoryBlock
+{
+	VkDeviceMemory	memory = VK_NULL_HANDLE;
+	void*			mapped = nullptr;
+	uint32_t		memoryType = 0;
+	TlsfHeap		heap;
+};
+
+namespace
+{
+	inline uint32_t FindHighestBit(uint64_t value)
+	{
+#ifdef _MSC_VER
+		// 32-bit scans, the 64-bit intrinsics do not exist on Win32
+		unsigned long index;
+		if (_BitScanReverse(&index, static_cast<unsigned long>(value >> 32)))
+			return static_cast<uint32_t>(index) + 32;
+		_BitScanReverse(&index, static_cast<unsigned long>(value));
+		return static_cast<uint32_t>(index);
+#else
+		return 63 - static_cast<uint32_t>(__builtin_clzll(value));
+#endif
+	}
+
+	inline uint32_t FindLowestBit(uint64_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		if (_BitScanForward(&index, static_cast<unsigned long>(value)))
+			return static_cast<uint32_t>(index);
+		_BitScanForward(&index, static_cast<unsigned long>(value >> 32));
+		return static_cast<uint32_t>(index) + 32;
+#else
+		return static_cast<uint32_t>(__builtin_ctzll(value));
+#endif
+	}
+
+	inline VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+void TlsfHeap::Create(VkDeviceSize size)
+{
+	_nodes.clear();
+	_unusedNodes.clear();
+	_firstLevelMap = 0;
+	std::fill(std::begin(_secondLevelMap), std::end(_secondLevelMap), 0);
+	for (uint32_t i = 0; i < FIRST_LEVEL_COUNT; ++i)
+		std::fill(std::begin(_freeLists[i]), std::end(_freeLists[i]), NO_NODE);
+
+	_size = size;
+	_usedBytes = 0;
+
+	uint32_t node = NewNode();
+	_nodes[node] = { 0, size, NO_NODE, NO_NODE, NO_NODE, NO_NODE, true };
+	InsertFree(node);
+}
+
+void TlsfHeap::GetClass(VkDeviceSize size, uint32_t& firstLevel, uint32_t& secondLevel)
+{
+	if (size < (1ull << SMALL_SIZE_BITS))
+	{
+		firstLevel = 0;
+		secondLevel = static_cast<uint32_t>(size >> (SMALL_SIZE_BITS - SECOND_LEVEL_BITS));
+		return;
+	}
+
+	uint32_t highestBit = FindHighestBit(size);
+	firstLevel = highestBit - SMALL_SIZE_BITS + 1;
+	secondLevel = static_cast<uint32_t>(size >> (highestBit - SECOND_LEVEL_BITS)) & (SECOND_LEVEL_COUNT - 1);
+}
+
+uint32_t TlsfHeap::NewNode()
+{
+	if (!_unusedNodes.empty())
+	{
+		uint32_t node = _unusedNodes.back();
+		_unusedNodes.pop_back();
+		return node;
+	}
+
+	_nodes.push_back({});
+	return static_cast<uint32_t>(_nodes.size() - 1);
+}
+
+void TlsfHeap::InsertFree(uint32_t node)
+{
+	uint32_t firstLevel, secondLevel;
+	GetClass(_nodes[node].size, firstLevel, secondLevel);
+
+	uint32_t head = _freeLists[firstLevel][secondLevel];
+	_nodes[node].free = true;
+	_nodes[node].previousFree = NO_NODE;
+	_nodes[node].nextFree = head;
+	if (head != NO_NODE)
+		_nodes[head].previousFree = node;
+
+	_freeLists[firstLevel][secondLevel] = node;
+	_secondLevelMap[firstLevel] |= 1u << secondLevel;
+	_firstLevelMap |= 1ull << firstLevel;
+}
+
+void TlsfHeap::RemoveFree(uint32_t node)
+{
+	uint32_t firstLevel, secondLevel;
+	GetClass(_nodes[node].size, firstLevel, secondLevel);
+
+	Node& current = _nodes[node];
+	if (current.previousFree != NO_NODE)
+		_nodes[current.previousFree].nextFree = current.nextFree;
+	else
+		_freeLists[firstLevel][secondLevel] = current.nextFree;
+
+	if (current.nextFree != NO_NODE)
+		_nodes[current.nextFree].previousFree = current.previousFree;
+
+	current.free = false;
+	current.previousFree = NO_NODE;
+	current.nextFree = NO_NODE;
+
+	if (_freeLists[firstLevel][secondLevel] == NO_NODE)
+	{
+		_secondLevelMap[firstLevel] &= ~(1u << secondLevel);
+		if (_secondLevelMap[firstLevel] == 0)
+			_firstLevelMap &= ~(1ull << firstLevel);
+	}
+}
+
+void TlsfHeap::Split(uint32_t node, VkDeviceSize size)
+{
+	if (_nodes[node].size <= size)
+		return;
+
+	// NewNode may grow the vector, no references across it
+	uint32_t tail = NewNode();
+	Node& current = _nodes[node];
+	_nodes[tail] = { current.offset + size, current.size - size, node, current.next, NO_NODE, NO_NODE, true };
+
+	if (current.next != NO_NODE)
+		_nodes[current.next].previous = tail;
+	current.next = tail;
+	current.size = size;
+
+	uint32_t next = _nodes[tail].next;
+	if (next != NO_NODE && _nodes[next].free)
+	{
+		RemoveFree(next);
+		Merge(tail, next);
+	}
+
+	InsertFree(tail);
+}
+
+void TlsfHeap::Merge(uint32_t node, uint32_t next)
+{
+	Node& current = _nodes[node];
+	current.size += _nodes[next].size;
+	current.next = _nodes[next].next;
+	if (current.next != NO_NODE)
+		_nodes[current.next].previous = node;
+
+	_unusedNodes.push_back(next);
+}
+
+uint32_t TlsfHeap::Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+{
+	size = std::max<VkDeviceSize>(size, 1);
+	alignment = std::max<VkDeviceSize>(alignment, 1);
+
+	// Any free range of the class above the request fits it with the worst alignment padding
+	const VkDeviceSize request = size + alignment - 1;
+	if (request > _size - _usedBytes)
+		return NO_NODE;
+
+	VkDeviceSize rounded = request;
+	if (request >= (1ull << SMALL_SIZE_BITS))
+		rounded += (1ull << (FindHighestBit(request) - SECOND_LEVEL_BITS)) - 1;
+	else
+		rounded += (1ull << (SMALL_SIZE_BITS - SECOND_LEVEL_BITS)) - 1;
+
+	uint32_t firstLevel, secondLevel;
+	GetClass(rounded, firstLevel, secondLevel);
+
+	uint32_t node = NO_NODE;
+	if (firstLevel < FIRST_LEVEL_COUNT)
+	{
+		uint32_t secondLevelMap = _secondLevelMap[firstLevel] & (~0u << secondLevel);
+		if (secondLevelMap == 0)
+		{
+			uint64_t firstLevelMap = firstLevel + 1 < 64 ? _firstLevelMap & (~0ull << (firstLevel + 1)) : 0;
+			if (firstLevelMap != 0)
+			{
+				firstLevel = FindLowestBit(firstLevelMap);
+				secondLevelMap = _secondLevelMap[firstLevel];
+			}
+		}
+
+		if (secondLevelMap != 0)
+			node = _freeLists[firstLevel][FindLowestBit(secondLevelMap)];
+	}
+
+	// The rounding skips ranges of the request's own class that may still fit, look through it
+	// before giving up so a nearly full heap is still usable
+	if (node == NO_NODE)
+	{
+		GetClass(request, firstLevel, secondLevel);
+		for (uint32_t candidate = _freeLists[firstLevel][secondLevel]; candidate != NO_NODE; candidate = _nodes[candidate].nextFree)
+		{
+			const Node& free = _nodes[candidate];
+			if (AlignUp(free.offset, alignment) + size <= free.offset + free.size)
+			{
+				node = candidate;
+				break;
+			}
+		}
+
+		if (node == NO_NODE)
+			return NO_NODE;
+	}
+
+	RemoveFree(node);
+
+	// Padding in front of the aligned offset goes back to the free lists, the previous node is in
+	// use (free neighbours are always merged) so it cannot be merged with anything
+	const VkDeviceSize aligned = AlignUp(_nodes[node].offset, alignment);
+	const VkDeviceSize padding = aligned - _nodes[node].offset;
+	if (padding > 0)
+	{
+		uint32_t front = NewNode();
+		Node& current = _nodes[node];
+		_nodes[front] = { current.offset, padding, current.previous, node, NO_NODE, NO_NODE, true };
+
+		if (current.previous != NO_NODE)
+			_nodes[current.previous].next = front;
+		current.previous = front;
+		current.offset = aligned;
+		current.size -= padding;
+
+		InsertFree(front);
+	}
+
+	Split(node, size);
+
+	_nodes[node].free = false;
+	_usedBytes += _nodes[node].size;
+	offset = aligned;
+
+	return node;
+}
+
+void TlsfHeap::Free(uint32_t node)
+{
+	_usedBytes -= _nodes[node].size;
+	_nodes[node].free = true;
+
+	uint32_t next = _nodes[node].next;
+	if (next != NO_NODE && _nodes[next].free)
+	{
+		RemoveFree(next);
+		Merge(node, next);
+	}
+
+	uint32_t previous = _nodes[node].previous;
+	if (previous != NO_NODE && _nodes[previous].free)
+	{
+		RemoveFree(previous);
+		Merge(previous, node);
+		node = previous;
+	}
+
+	InsertFree(node);
+}
+
+void MemoryAllocator::Create(VkPhysicalDevice physicalDevice, VkDevice device)
+{
+	_device = device;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &_memoryProperties);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	_bufferImageGranularity = properties.limits.bufferImageGranularity;
+	_nonCoherentAtomSize = properties.limits.nonCoherentAtomSize;
+
+	_pools.assign(_memoryProperties.memoryTypeCount * 2, {});
+	_dedicatedCount = 0;
+	_allocationCount = 0;
+	_dedicatedBytes = 0;
+}
+
+void MemoryAllocator::Destroy()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (_allocationCount > 0)
+		std::cerr << "memory allocator: " << _allocationCount << " allocations still alive at destruction" << std::endl;
+
+	for (std::vector<MemoryBlock*>& pool : _pools)
+	{
+		for (MemoryBlock* block : pool)
+		{
+			vkFreeMemory(_device, block->memory, nullptr);
+			delete block;
+		}
+		pool.clear();
+	}
+}
+
+uint32_t MemoryAllocator::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const
+{
+	for (uint32_t i = 0; i < _memoryProperties.memoryTypeCount; i++)
+	{
+		if (typeFilter & (1 << i) && (_memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+			return i;
+	}
+
+	throw std::runtime_error("failed to find suitable memory type!");
+}
+
+VkDeviceSize MemoryAllocator::GetBlockSize(uint32_t memoryType) const
+{
+	VkDeviceSize heapSize = _memoryProperties.memoryHeaps[_memoryProperties.memoryTypes[memoryType].heapIndex].size;
+	return heapSize < MEMORY_SMALL_HEAP_SIZE ? heapSize / 8 : MEMORY_BLOCK_SIZE;
+}
+
+void* MemoryAllocator::Map(VkDeviceMemory memory, uint32_t memoryType)
+{
+	if (!(_memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+		return nullptr;
+
+	// A memory object can only be mapped once, sub-allocations share this mapping
+	void* mapped = nullptr;
+	if (vkMapMemory(_device, memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS)
+		throw std::runtime_error("failed to map memory!");
+
+	return mapped;
+}
+
+MemoryAllocation MemoryAllocator::AllocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties)
+{
+	VkMemoryDedicatedRequirements dedicatedRequirements = {};
+	dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+	VkMemoryRequirements2 requirements = {};
+	requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	requirements.pNext = &dedicatedRequirements;
+
+	VkBufferMemoryRequirementsInfo2 info = {};
+	info.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+	info.buffer = buffer;
+	vkGetBufferMemoryRequirements2(_device, &info, &requirements);
+
+	bool dedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+	MemoryAllocation allocation = Allocate(requirements.memoryRequirements, dedicated, buffer, VK_NULL_HANDLE, properties, false);
+
+	if (vkBindBufferMemory(_device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS)
+	{
+		Free(allocation);
+		throw std::runtime_error("failed to bind buffer memory!");
+	}
+
+	return allocation;
+}
+
+MemoryAllocation MemoryAllocator::AllocateForImage(VkImage image, VkMemoryPropertyFlags properties, bool linearTiling)
+{
+	VkMemoryDedicatedRequirements dedicatedRequirements = {};
+	dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+	VkMemoryRequirements2 requirements = {};
+	requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	requirements.pNext = &dedicatedRequirements;
+
+	VkImageMemoryRequirementsInfo2 info = {};
+	info.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+	info.image = image;
+	vkGetImageMemoryRequirements2(_device, &info, &requirements);
+
+	bool dedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+	MemoryAllocation allocation = Allocate(requirements.memoryRequirements, dedicated, VK_NULL_HANDLE, image, properties, !linearTiling);
+
+	if (vkBindImageMemory(_device, image, allocation.memory, allocation.offset) != VK_SUCCESS)
+	{
+		Free(allocation);
+		throw std::runtime_error("failed to bind image memory!");
+	}
+
+	return allocation;
+}
+
+MemoryAllocation MemoryAllocator::Allocate(const VkMemoryRequirements& requirements, bool dedicated, VkBuffer buffer, VkImage image,
+	VkMemoryPropertyFlags properties, bool optimalImage)
+{
+	const uint32_t memoryType = FindMemoryType(requirements.memoryTypeBits, properties);
+	const VkDeviceSize blockSize = GetBlockSize(memoryType);
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (dedicated || requirements.size > blockSize / MEMORY_DEDICATED_FRACTION)
+		return AllocateDedicated(requirements, memoryType, buffer, image);
+
+	// With a granularity of 1 linear and optimal resources may be neighbours, otherwise they get
+	// their own blocks instead of padding every range to the granularity
+	const uint32_t poolIndex = memoryType * 2 + (optimalImage && _bufferImageGranularity > 1 ? 1 : 0);
+	std::vector<MemoryBlock*>& pool = _pools[poolIndex];
+
+	MemoryAllocation allocation;
+	allocation.allocator = this;
+	allocation.memoryType = memoryType;
+	allocation.size = requirements.size;
+
+	for (MemoryBlock* block : pool)
+	{
+		allocation.node = block->heap.Allocate(requirements.size, requirements.alignment, allocation.offset);
+		if (allocation.node != UINT32_MAX)
+		{
+			allocation.block = block;
+			break;
+		}
+	}
+
+	if (allocation.block == nullptr)
+	{
+		VkMemoryAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = blockSize;
+		allocInfo.memoryTypeIndex = memoryType;
+
+		VkDeviceMemory memory;
+		// Out of memory for a whole block, the resource may still fit on its own
+		if (vkAllocateMemory(_device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+			return AllocateDedicated(requirements, memoryType, buffer, image);
+
+		MemoryBlock* block = new MemoryBlock;
+		block->memory = memory;
+		block->memoryType = memoryType;
+		block->heap.Create(blockSize);
+		try
+		{
+			block->mapped = Map(memory, memoryType);
+		}
+		catch (...)
+		{
+			vkFreeMemory(_device, memory, nullptr);
+			delete block;
+			throw;
+		}
+		pool.push_back(block);
+
+		allocation.node = block->heap.Allocate(requirements.size, requirements.alignment, allocation.offset);
+		allocation.block = block;
+	}
+
+	allocation.memory = allocation.block->memory;
+	if (allocation.block->mapped != nullptr)
+		allocation.mapped = static_cast<char*>(allocation.block->mapped) + allocation.offset;
+
+	_allocationCount++;
+	return allocation;
+}
+
+MemoryAllocation MemoryAllocator::AllocateDedicated(const VkMemoryRequirements& requirements, uint32_t memoryType, VkBuffer buffer, VkImage image)
+{
+	VkMemoryDedicatedAllocateInfo dedicatedInfo = {};
+	dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+	dedicatedInfo.buffer = buffer;
+	dedicatedInfo.image = image;
+
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.pNext = &dedicatedInfo;
+	allocInfo.allocationSize = requirements.size;
+	allocInfo.memoryTypeIndex = memoryType;
+
+	MemoryAllocation allocation;
+	allocation.allocator = this;
+	allocation.memoryType = memoryType;
+	allocation.size = requirements.size;
+
+	if (vkAllocateMemory(_device, &allocInfo, nullptr, &allocation.memory) != VK_SUCCESS)
+		throw std::runtime_error("failed to allocate memory!");
+
+	try
+	{
+		allocation.mapped = Map(allocation.memory, memoryType);
+	}
+	catch (...)
+	{
+		vkFreeMemory(_device, allocation.memory, nullptr);
+		throw;
+	}
+
+	_dedicatedCount++;
+	_dedicatedBytes += requirements.size;
+	_allocationCount++;
+	return allocation;
+}
+
+void MemoryAllocator::Free(MemoryAllocation& allocation)
+{
+	if (!allocation.IsValid())
+		return;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	MemoryBlock* block = allocation.block;
+	if (block == nullptr)
+	{
+		vkFreeMemory(_device, allocation.memory, nullptr);
+		_dedicatedCount--;
+		_dedicatedBytes -= allocation.size;
+	}
+	else
+	{
+		block->heap.Free(allocation.node);
+
+		// One empty block per pool is kept so a pool emptying and refilling does not thrash
+		if (block->heap.IsEmpty())
+		{
+			for (std::vector<MemoryBlock*>& pool : _pools)
+			{
+				auto it = std::find(pool.begin(), pool.end(), block);
+				if (it == pool.end())
+					continue;
+
+				bool otherEmpty = std::any_of(pool.begin(), pool.end(), [block](MemoryBlock* other) { return other != block && other->heap.IsEmpty(); });
+				if (otherEmpty)
+				{
+					vkFreeMemory(_device, block->memory, nullptr);
+					delete block;
+					pool.erase(it);
+				}
+				break;
+			}
+		}
+	}
+
+	_allocationCount--;
+	allocation = {};
+}
+
+void MemoryAllocator::Flush(const MemoryAllocation& allocation, VkDeviceSize offset, VkDeviceSize size)
+{
+	VkMemoryPropertyFlags flags = _memoryProperties.memoryTypes[allocation.memoryType].propertyFlags;
+	if (!allocation.IsValid() || !(flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) || (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+		return;
+
+	if (size == VK_WHOLE_SIZE)
+		size = allocation.size - offset;
+
+	// Blocks are multiples of the atom size, a dedicated allocation may not be: its end is flushed as VK_WHOLE_SIZE
+	const VkDeviceSize memorySize = allocation.block != nullptr ? allocation.block->heap.GetSize() : allocation.size;
+	const VkDeviceSize begin = (allocation.offset + offset) / _nonCoherentAtomSize * _nonCoherentAtomSize;
+	const VkDeviceSize end = AlignUp(allocation.offset + offset + size, _nonCoherentAtomSize);
+
+	VkMappedMemoryRange range = {};
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.memory = allocation.memory;
+	range.offset = begin;
+	range.size = end >= memorySize ? VK_WHOLE_SIZE : end - begin;
+
+	if (vkFlushMappedMemoryRanges(_device, 1, &range) != VK_SUCCESS)
+		throw std::runtime_error("failed to flush mapped memory!");
+}
+
+MemoryStatistics MemoryAllocator::GetStatistics()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	MemoryStatistics statistics;
+	statistics.dedicatedCount = _dedicatedCount;
+	statistics.allocationCount = _allocationCount;
+	statistics.usedBytes = _dedicatedBytes;
+	statistics.reservedBytes = _dedicatedBytes;
+
+	for (const std::vector<MemoryBlock*>& pool : _pools)
+	{
+		for (const MemoryBlock* block : pool)
+		{
+			statistics.blockCount++;
+			statistics.usedBytes += block->heap.GetUsedBytes();
+			statistics.reservedBytes += block->heap.GetSize();
+		}
+	}
+
+	return statistics;
+}
@@ -1,108 +1,246 @@
 #include "Mesh.h"
+#include "ObjParser.h"
+#include "VertexWelder.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "Hash.h"
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
 
-#include <unordered_map>
+uint64_t MeshLoadSettings::GetHash() const
+{
+	uint64_t hash = Hash64(&weldTolerance, sizeof(weldTolerance));
+	hash = Hash64(&optimize, sizeof(optimize), hash);
+	hash = Hash64(&vertexFormat, sizeof(vertexFormat), hash);
+	hash = Hash64(&lodCount, sizeof(lodCount), hash);
+
+	return hash;
+}
+
+Mesh& Mesh::LoadGeometry(const char* modelFile, const MeshLoadSettings& settings)
+{
+	_vertexFormat = settings.vertexFormat;
+
+	if (!LoadCache(modelFile, settings))
+	{
+		LoadObj(modelFile, settings);
+		WriteCache(modelFile, settings);
+	}
+
+	return *this;
+}
+
+void Mesh::LoadObj(const char* modelFile, const MeshLoadSettings& settings)
+{
+	ObjParser parser;
+	parser.Parse(modelFile);
+
+	VertexWelder welder;
+	welder.Weld(parser, settings.weldTolerance);
+
+	_vertices = std::move(welder.GetVertices());
+	_indices = std::move(welder.GetIndices());
+
+	// Nothing to upload or draw, and zero sized buffers are invalid
+	if (_indices.empty())
+		throw std::runtime_error(std::string(modelFile) + " has no faces");
+
+	if (settings.optimize)
+		Optimize(modelFile);
+
+	_bounds = {};
+	for (const Vertex& vertex : _vertices)
+		_bounds.Extend(vertex.pos);
 
-Mesh& Mesh::LoadMesh(const char* modelFile, const char* textureFile)
+	BuildMeshlets(_meshlets, _vertices, _indices);
+	_meshletData = _meshlets.data();
+	_meshletCount = static_cast<uint32_t>(_meshlets.size());
+
+	BuildLods(settings);
+
+	Pack();
+}
+
+void Mesh::BuildLods(const MeshLoadSettings& settings)
 {
-	tinyobj::attrib_t attrib;
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
-	std::string warn, err;
+	const uint32_t lodCount = std::max(1u, std::min<uint32_t>(settings.lodCount, MESH_MAX_LODS));
 
-	std::unordered_map<Vertex, uint32_t> uniqueVertices = {};
+	_lods.clear();
+	_lods.push_back({ 0, static_cast<uint32_t>(_indices.size()), 0.0f, 0 });
 
-	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, modelFile))
-		throw std::runtime_error(warn + err);
+	// Each LOD simplifies the previous one, so the step errors are summed into an estimate against LOD 0
+	std::vector<uint32_t> previous(_indices);
+	std::vector<uint32_t> simplified;
+	float error = 0.0f;
 
-	for (const auto& shape : shapes)
+	while (_lods.size() < lodCount)
 	{
-		for (const auto& index : shape.mesh.indices)
-		{
-			Vertex vertex = {};
-
-			vertex.pos = {
-				attrib.vertices[3 * index.vertex_index + 0],
-				attrib.vertices[3 * index.vertex_index + 1],
-				attrib.vertices[3 * index.vertex_index + 2]
-			};
-
-			vertex.texCoord = {
-				attrib.texcoords[2 * index.texcoord_index + 0],
-				1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-			};
-
-			vertex.normal = { 
-				attrib.vertices[3 * index.normal_index + 0],
-				attrib.vertices[3 * index.normal_index + 1],
-				attrib.vertices[3 * index.normal_index + 2]
-			};
-
-			if (uniqueVertices.count(vertex) == 0)
-			{
-				uniqueVertices[vertex] = static_cast<uint32_t>(_vertices.size());
-				_vertices.push_back(vertex);
-			}
-			_indices.push_back(uniqueVertices[vertex]);
-		}
+		error += SimplifyMesh(simplified, _vertices, previous, previous.size() / 2);
+		if (simplified.empty() || simplified.size() > previous.size() * MESH_LOD_MIN_REDUCTION)
+			break;
+
+		if (settings.optimize)
+			OptimizeVertexCache(simplified, static_cast<uint32_t>(_vertices.size()));
+
+		_lods.push_back({ static_cast<uint32_t>(_indices.size()), static_cast<uint32_t>(simplified.size()), error, 0 });
+		_indices.insert(_indices.end(), simplified.begin(), simplified.end());
+
+		previous.swap(simplified);
 	}
 
-	_bindingDescriptor = Vertex::GetBindingDescription();
-	_attributeDescriptions = Vertex::GetAttributeDescriptions();
-	_info = {};
-	_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	_info.vertexBindingDescriptionCount = 1;
-	_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(_attributeDescriptions.size());
-	_info.pVertexBindingDescriptions = &_bindingDescriptor;
-	_info.pVertexAttributeDescriptions = _attributeDescriptions.data();
+	_lodData = _lods.data();
+	_lodCount = static_cast<uint32_t>(_lods.size());
+}
 
-	_texture.Load(textureFile);
+void Mesh::Pack()
+{
+	_vertexCount = static_cast<uint32_t>(_vertices.size());
+	_indexCount = static_cast<uint32_t>(_indices.size());
+	_indexType = ChooseIndexType(_vertexCount);
+
+	if (_vertexFormat == VERTEX_FORMAT_PACKED)
+	{
+		_packedVertices.resize(_vertices.size());
+		for (size_t i = 0; i < _vertices.size(); ++i)
+			_packedVertices[i] = PackedVertex::Pack(_vertices[i], _bounds);
+
+		_vertices = {};
+		_vertexData = _packedVertices.data();
+	}
+	else
+		_vertexData = _vertices.data();
+
+	if (_indexType == VK_INDEX_TYPE_UINT16)
+	{
+		_indices16.assign(_indices.begin(), _indices.end());
+		_indices = {};
+		_indexData = _indices16.data();
+	}
+	else
+		_indexData = _indices.data();
 }
 
-void Mesh::CreateBuffers(Context context)
+VkIndexType Mesh::ChooseIndexType(uint32_t vertexCount)
 {
-	CreateVertexBuffer(context);
-	CreateIndexBuffer(context);
-	_texture.CreateTexture(context);
+	return vertexCount <= MAX_UINT16_INDEXED_VERTICES ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
 }
 
-void Mesh::CreateVertexBuffer(Context context)
+glm::vec3 Mesh::GetPositionScale() const
 {
-	VkDeviceSize bufferSize = sizeof(_vertices[0]) * _vertices.size();
+	return _vertexFormat == VERTEX_FORMAT_PACKED ? _bounds.GetExtent() : glm::vec3(1.0f);
+}
 
-	Buffer stagingBuffer;
-	stagingBuffer.CreateBuffer(context, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+glm::vec3 Mesh::GetPositionOffset() const
+{
+	return _vertexFormat == VERTEX_FORMAT_PACKED ? _bounds.min : glm::vec3(0.0f);
+}
 
-	stagingBuffer.MapMemory(context.device, 0, bufferSize, 0, _vertices.data());
+void Mesh::Optimize(const char* modelFile)
+{
+	VertexCacheStatistics before = AnalyzeVertexCache(_indices, static_cast<uint32_t>(_vertices.size()));
 
-	_vertexBuffer.CreateBuffer(context, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	std::vector<uint32_t> clusters;
+	OptimizeVertexCache(_indices, static_cast<uint32_t>(_vertices.size()), VERTEX_CACHE_SIZE, &clusters);
+	OptimizeOverdraw(_indices, _vertices, clusters);
+	OptimizeVertexFetch(_vertices, _indices);
 
-	stagingBuffer.CopyBuffer(context, _vertexBuffer, bufferSize);
+	VertexCacheStatistics after = AnalyzeVertexCache(_indices, static_cast<uint32_t>(_vertices.size()));
 
-	stagingBuffer.Destroy(context.device);
+	std::cout << modelFile << ": ACMR " << before.acmr << " -> " << after.acmr
+		<< ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
 }
 
-void Mesh::CreateIndexBuffer(Context context)
+bool Mesh::LoadCache(const char* modelFile, const MeshLoadSettings& settings)
 {
-	VkDeviceSize bufferSize = sizeof(_indices[0]) * _indices.size();
+	if (!_cache.Open(modelFile, GetVertexStride(_vertexFormat), settings.GetHash()))
+		return false;
+
+	uint64_t vertexSize = 0;
+	uint64_t indexSize = 0;
+	uint32_t boundsCount = 0;
+	const Bounds* bounds = _cache.GetSection<Bounds>(MeshCache::SECTION_BOUNDS, boundsCount);
+	_meshletData = _cache.GetSection<Meshlet>(MeshCache::SECTION_MESHLETS, _meshletCount);
+	_lodData = _cache.GetSection<MeshLod>(MeshCache::SECTION_LODS, _lodCount);
+	_vertexData = _cache.GetSection(MeshCache::SECTION_VERTICES, vertexSize);
+	_indexData = _cache.GetSection(MeshCache::SECTION_INDICES, indexSize);
+
+	// The index type is not stored, it follows from the vertex count like in Pack
+	_vertexCount = static_cast<uint32_t>(vertexSize / GetVertexStride(_vertexFormat));
+	_indexType = ChooseIndexType(_vertexCount);
+	_indexCount = static_cast<uint32_t>(indexSize / GetIndexStride());
+
+	if (bounds == nullptr || boundsCount != 1 || _vertexData == nullptr || _indexData == nullptr || _meshletData == nullptr ||
+		_meshletCount == 0 || _lodData == nullptr || _lodCount == 0)
+	{
+		_cache.Close();
+		return false;
+	}
 
-	Buffer stagingBuffer;
-	stagingBuffer.CreateBuffer(context, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	// Vertices and indices stay in the mapping and are copied from there straight into the staging ring
+	_bounds = *bounds;
 
-	stagingBuffer.MapMemory(context.device, 0, bufferSize, 0, _indices.data());
+	return true;
+}
+
+void Mesh::WriteCache(const char* modelFile, const MeshLoadSettings& settings)
+{
+	std::vector<MeshCache::Section> sections = {
+		{ MeshCache::SECTION_VERTICES, _vertexData, GetVertexStride(_vertexFormat) * static_cast<uint64_t>(_vertexCount) },
+		{ MeshCache::SECTION_INDICES, _indexData, GetIndexStride() * static_cast<uint64_t>(_indexCount) },
+		{ MeshCache::SECTION_BOUNDS, &_bounds, sizeof(Bounds) },
+		{ MeshCache::SECTION_MESHLETS, _meshletData, sizeof(Meshlet) * static_cast<uint64_t>(_meshletCount) },
+		{ MeshCache::SECTION_LODS, _lodData, sizeof(MeshLod) * static_cast<uint64_t>(_lodCount) },
+	};
+
+	// The cache is only an accelerator, failing to write it must not fail the load
+	try
+	{
+		MeshCache::Write(modelFile, GetVertexStride(_vertexFormat), settings.GetHash(), sections);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "mesh cache: " << e.what() << std::endl;
+	}
+}
 
-	_indexBuffer.CreateBuffer(context, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+void Mesh::CreateGeometryBuffers(Context context)
+{
+	CreateVertexBuffer(context);
+	CreateIndexBuffer(context);
+	CreateMeshletBuffer(context);
+}
+
+void Mesh::CreateVertexBuffer(Context context)
+{
+	_vertexRange = context.geometry->AllocateVertices(_vertexCount, GetVertexStride(_vertexFormat));
+
+	context.staging->CopyToBuffer(_vertexData, _vertexRange.size, _vertexRange.buffer, _vertexRange.offset);
+}
+
+void Mesh::CreateIndexBuffer(Context context)
+{
+	_indexRange = context.geometry->AllocateIndices(_indexCount, GetIndexStride());
+
+	context.staging->CopyToBuffer(_indexData, _indexRange.size, _indexRange.buffer, _indexRange.offset);
+}
+
+void Mesh::CreateMeshletBuffer(Context context)
+{
+	VkDeviceSize bufferSize = sizeof(Meshlet) * static_cast<VkDeviceSize>(_meshletCount);
 
-	stagingBuffer.CopyBuffer(context, _indexBuffer, bufferSize);
+	_meshletBuffer.CreateBuffer(context, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-	stagingBuffer.Destroy(context.device);
+	context.staging->CopyToBuffer(_meshletData, bufferSize, _meshletBuffer.GetBuffer());
 }
 
 void Mesh::Destroy(VkDevice device)
 {
-	_indexBuffer.Destroy(device);
-	_vertexBuffer.Destroy(device);
-	_texture.Destroy(device);
+	_meshletBuffer.Destroy(device);
+	if (_indexRange.IsValid())
+		_indexRange.pool->Free(_indexRange);
+	if (_vertexRange.IsValid())
+		_vertexRange.pool->Free(_vertexRange);
+	_cache.Close();
 }
\ No newline at end of file
@@ -0,0 +1,197 @@
+#include "MeshCache.h"
+#include "Hash.h"
+
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+static const uint32_t MESH_CACHE_MAGIC = 0x4843534d; // "MSCH"
+static const uint64_t MESH_CACHE_ALIGNMENT = 64;
+
+struct MeshCacheHeader
+{
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	vertexStride;
+	uint32_t	sectionCount;
+	uint64_t	sourceSize;
+	int64_t		sourceTime;
+	uint64_t	sourceHash;
+	uint64_t	settingsHash;
+};
+
+struct MeshCacheSection
+{
+	uint32_t	id;
+	uint32_t	padding;
+	uint64_t	offset;
+	uint64_t	size;
+};
+
+static bool GetSourceInfo(const char* sourceFile, uint64_t& size, int64_t& time)
+{
+	std::error_code error;
+	size = std::filesystem::file_size(sourceFile, error);
+	if (error)
+		return false;
+
+	time = static_cast<int64_t>(std::filesystem::last_write_time(sourceFile, error).time_since_epoch().count());
+	return !error;
+}
+
+static uint64_t HashSource(const char* sourceFile)
+{
+	MappedFile source;
+	if (!source.Open(sourceFile))
+		throw std::runtime_error(std::string("failed to map mesh source ") + sourceFile);
+
+	uint64_t hash = Hash64(source.GetData(), source.GetSize());
+	source.Close();
+
+	return hash;
+}
+
+std::string MeshCache::GetCachePath(const char* sourceFile)
+{
+	return std::string(sourceFile) + MESH_CACHE_EXTENSION;
+}
+
+bool MeshCache::Open(const char* sourceFile, uint32_t vertexStride, uint64_t settingsHash)
+{
+	Close();
+
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	if (!GetSourceInfo(sourceFile, sourceSize, sourceTime))
+		return false;
+
+	std::string path = GetCachePath(sourceFile);
+	MeshCacheHeader header = {};
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+			return false;
+	}
+
+	if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION ||
+		header.vertexStride != vertexStride || header.settingsHash != settingsHash || header.sourceSize != sourceSize)
+		return false;
+
+	// A different timestamp alone does not mean different content (fresh checkout, touched file),
+	// so fall back to the content hash and refresh the stored timestamp when it still matches
+	if (header.sourceTime != sourceTime)
+	{
+		if (HashSource(sourceFile) != header.sourceHash)
+			return false;
+
+		header.sourceTime = sourceTime;
+		std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	}
+
+	if (!_file.Open(path.c_str()))
+		return false;
+
+	uint64_t tableEnd = sizeof(MeshCacheHeader) + header.sectionCount * sizeof(MeshCacheSection);
+	if (_file.GetSize() < tableEnd)
+	{
+		Close();
+		return false;
+	}
+
+	const MeshCacheSection* sections = reinterpret_cast<const MeshCacheSection*>(_file.GetData() + sizeof(MeshCacheHeader));
+	for (uint32_t i = 0; i < header.sectionCount; ++i)
+	{
+		if (sections[i].offset + sections[i].size > _file.GetSize())
+		{
+			Close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void MeshCache::Close()
+{
+	_file.Close();
+}
+
+const void* MeshCache::GetSection(uint32_t id, uint64_t& size) const
+{
+	size = 0;
+	if (!_file.IsOpen())
+		return nullptr;
+
+	const MeshCacheHeader* header = reinterpret_cast<const MeshCacheHeader*>(_file.GetData());
+	const MeshCacheSection* sections = reinterpret_cast<const MeshCacheSection*>(_file.GetData() + sizeof(MeshCacheHeader));
+
+	for (uint32_t i = 0; i < header->sectionCount; ++i)
+	{
+		if (sections[i].id == id)
+		{
+			size = sections[i].size;
+			return _file.GetData() + sections[i].offset;
+		}
+	}
+
+	return nullptr;
+}
+
+void MeshCache::Write(const char* sourceFile, uint32_t vertexStride, uint64_t settingsHash, const std::vector<Section>& sections)
+{
+	MeshCacheHeader header = {};
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	header.vertexStride = vertexStride;
+	header.settingsHash = settingsHash;
+	header.sectionCount = static_cast<uint32_t>(sections.size());
+
+	if (!GetSourceInfo(sourceFile, header.sourceSize, header.sourceTime))
+		throw std::runtime_error(std::string("failed to stat mesh source ") + sourceFile);
+	header.sourceHash = HashSource(sourceFile);
+
+	// Sections are aligned so the mapped data can be used in place as typed arrays
+	std::vector<MeshCacheSection> table(sections.size());
+	uint64_t offset = sizeof(MeshCacheHeader) + sections.size() * sizeof(MeshCacheSection);
+	for (size_t i = 0; i < sections.size(); ++i)
+	{
+		offset = (offset + MESH_CACHE_ALIGNMENT - 1) & ~(MESH_CACHE_ALIGNMENT - 1);
+		table[i].id = sections[i].id;
+		table[i].padding = 0;
+		table[i].offset = offset;
+		table[i].size = sections[i].size;
+		offset += sections[i].size;
+	}
+
+	// Write to a temporary file first so an interrupted write never leaves a valid-looking cache
+	std::string path = GetCachePath(sourceFile);
+	std::string tmpPath = path + ".tmp";
+	{
+		std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			throw std::runtime_error("failed to create mesh cache " + tmpPath);
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(MeshCacheSection));
+
+		const char zeros[MESH_CACHE_ALIGNMENT] = {};
+		for (size_t i = 0; i < sections.size(); ++i)
+		{
+			uint64_t position = static_cast<uint64_t>(file.tellp());
+			file.write(zeros, table[i].offset - position);
+			file.write(static_cast<const char*>(sections[i].data), sections[i].size);
+		}
+
+		if (!file)
+			throw std::runtime_error("failed to write mesh cache " + tmpPath);
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tmpPath, path, error);
+	if (error)
+	{
+		std::filesystem::remove(tmpPath, error);
+		throw std::runtime_error("failed to replace mesh cache " + path);
+	}
+}
@@ -0,0 +1,311 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace
+{
+	// FIFO cache simulation, a vertex is resident while fewer than cacheSize misses happened since it was loaded
+	class VertexCacheSimulator
+	{
+	public:
+		VertexCacheSimulator(uint32_t vertexCount, uint32_t cacheSize) :
+			_stamps(vertexCount, 0),
+			_time(cacheSize + 1),
+			_cacheSize(cacheSize)
+		{}
+
+		inline uint32_t Access(uint32_t vertex)
+		{
+			if (_time - _stamps[vertex] > _cacheSize)
+			{
+				_stamps[vertex] = _time++;
+				return 1;
+			}
+			return 0;
+		}
+
+		inline uint32_t Access(const uint32_t* triangle)
+		{
+			return Access(triangle[0]) + Access(triangle[1]) + Access(triangle[2]);
+		}
+
+		// Evicts everything by pushing all stamps out of the window
+		inline void Flush()
+		{
+			_time += _cacheSize + 1;
+		}
+
+	private:
+		std::vector<uint32_t>	_stamps;
+		uint32_t				_time;
+		uint32_t				_cacheSize;
+	};
+
+	int64_t SkipDeadEnd(const std::vector<uint32_t>& live, std::vector<uint32_t>& deadEnd, uint32_t& cursor, uint32_t vertexCount)
+	{
+		while (!deadEnd.empty())
+		{
+			uint32_t vertex = deadEnd.back();
+			deadEnd.pop_back();
+
+			if (live[vertex] > 0)
+				return vertex;
+		}
+
+		for (; cursor < vertexCount; ++cursor)
+		{
+			if (live[cursor] > 0)
+				return cursor;
+		}
+
+		return -1;
+	}
+}
+
+VertexCacheStatistics AnalyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize)
+{
+	VertexCacheSimulator cache(vertexCount, cacheSize);
+	std::vector<uint8_t> referenced(vertexCount, 0);
+
+	uint32_t misses = 0;
+	uint32_t uniqueCount = 0;
+	for (uint32_t index : indices)
+	{
+		misses += cache.Access(index);
+		uniqueCount += referenced[index] == 0;
+		referenced[index] = 1;
+	}
+
+	VertexCacheStatistics statistics = {};
+	if (!indices.empty())
+	{
+		statistics.acmr = static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+		statistics.atvr = static_cast<float>(misses) / static_cast<float>(uniqueCount);
+	}
+
+	return statistics;
+}
+
+void OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize, std::vector<uint32_t>* clusters)
+{
+	const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+
+	// Vertex to triangle adjacency, live counts how many of those triangles are not emitted yet
+	std::vector<uint32_t> live(vertexCount, 0);
+	for (uint32_t index : indices)
+		live[index]++;
+
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (uint32_t v = 0; v < vertexCount; ++v)
+		offsets[v + 1] = offsets[v] + live[v];
+
+	std::vector<uint32_t> adjacency(indices.size());
+	{
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (uint32_t i = 0; i < indices.size(); ++i)
+			adjacency[fill[indices[i]]++] = i / 3;
+	}
+
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	std::vector<uint8_t> emitted(triangleCount, 0);
+	std::vector<uint32_t> deadEnd;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> output;
+	deadEnd.reserve(indices.size());
+	output.reserve(indices.size());
+
+	uint32_t time = cacheSize + 1;
+	uint32_t cursor = 0;
+	bool clusterStart = true;
+
+	if (clusters)
+		clusters->clear();
+
+	int64_t fanning = SkipDeadEnd(live, deadEnd, cursor, vertexCount);
+	while (fanning >= 0)
+	{
+		if (clusterStart && clusters)
+			clusters->push_back(static_cast<uint32_t>(output.size() / 3));
+		clusterStart = false;
+
+		// Emit every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (uint32_t a = offsets[fanning]; a < offsets[fanning + 1]; ++a)
+		{
+			uint32_t triangle = adjacency[a];
+			if (emitted[triangle])
+				continue;
+
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				uint32_t vertex = indices[triangle * 3 + k];
+				output.push_back(vertex);
+				deadEnd.push_back(vertex);
+				candidates.push_back(vertex);
+				live[vertex]--;
+
+				if (time - cacheTime[vertex] > cacheSize)
+					cacheTime[vertex] = time++;
+			}
+
+			emitted[triangle] = 1;
+		}
+
+		// Next fanning vertex: the oldest 1-ring vertex that is still in the cache after its own fan
+		int64_t best = -1;
+		int64_t bestPriority = -1;
+		for (uint32_t vertex : candidates)
+		{
+			if (live[vertex] == 0)
+				continue;
+
+			int64_t priority = 0;
+			if (time - cacheTime[vertex] + 2 * live[vertex] <= cacheSize)
+				priority = time - cacheTime[vertex];
+
+			if (priority > bestPriority)
+			{
+				best = vertex;
+				bestPriority = priority;
+			}
+		}
+
+		if (best < 0)
+		{
+			best = SkipDeadEnd(live, deadEnd, cursor, vertexCount);
+			clusterStart = true;
+		}
+
+		fanning = best;
+	}
+
+	indices.swap(output);
+}
+
+void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& clusters,
+	uint32_t cacheSize, float threshold)
+{
+	const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+	if (triangleCount == 0 || clusters.empty())
+		return;
+
+	const uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+
+	// Soft boundaries: inside a hard cluster, start a new one as soon as the run since the last
+	// boundary (from a cold cache) is within threshold of the whole cluster's cold cache efficiency
+	std::vector<uint32_t> boundaries;
+	{
+		VertexCacheSimulator cache(vertexCount, cacheSize);
+		for (size_t c = 0; c < clusters.size(); ++c)
+		{
+			uint32_t start = clusters[c];
+			uint32_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+			cache.Flush();
+			uint32_t clusterMisses = 0;
+			for (uint32_t t = start; t < end; ++t)
+				clusterMisses += cache.Access(&indices[t * 3]);
+
+			const float clusterThreshold = threshold * static_cast<float>(clusterMisses) / static_cast<float>(end - start);
+			const size_t first = boundaries.size();
+
+			cache.Flush();
+			boundaries.push_back(start);
+			uint32_t runMisses = 0;
+			uint32_t runStart = start;
+			for (uint32_t t = start; t < end; ++t)
+			{
+				runMisses += cache.Access(&indices[t * 3]);
+
+				if (t + 1 < end && static_cast<float>(runMisses) <= clusterThreshold * static_cast<float>(t + 1 - runStart))
+				{
+					boundaries.push_back(t + 1);
+					runStart = t + 1;
+					runMisses = 0;
+					cache.Flush();
+				}
+			}
+
+			// The tail after the last split rarely reaches the target on its own, fold it into the previous run
+			if (boundaries.size() - first > 1)
+				boundaries.pop_back();
+		}
+	}
+
+	// Sort key: how far out along its own facing direction the cluster sits
+	const size_t clusterCount = boundaries.size();
+	std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f));
+	std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.0f));
+	std::vector<float> areas(clusterCount, 0.0f);
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+
+	for (size_t c = 0; c < clusterCount; ++c)
+	{
+		uint32_t end = c + 1 < clusterCount ? boundaries[c + 1] : triangleCount;
+		for (uint32_t t = boundaries[c]; t < end; ++t)
+		{
+			const glm::vec3& p0 = vertices[indices[t * 3 + 0]].pos;
+			const glm::vec3& p1 = vertices[indices[t * 3 + 1]].pos;
+			const glm::vec3& p2 = vertices[indices[t * 3 + 2]].pos;
+
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float area = glm::length(normal);
+
+			centroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+			normals[c] += normal;
+			areas[c] += area;
+		}
+
+		meshCentroid += centroids[c];
+		meshArea += areas[c];
+	}
+
+	if (meshArea > 0.0f)
+		meshCentroid /= meshArea;
+
+	std::vector<float> keys(clusterCount, 0.0f);
+	for (size_t c = 0; c < clusterCount; ++c)
+	{
+		float normalLength = glm::length(normals[c]);
+		if (areas[c] <= 0.0f || normalLength <= 0.0f)
+			continue;
+
+		glm::vec3 centroid = centroids[c] / areas[c];
+		keys[c] = glm::dot(centroid - meshCentroid, normals[c] / normalLength);
+	}
+
+	std::vector<uint32_t> order(clusterCount);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	for (uint32_t c : order)
+	{
+		uint32_t end = c + 1 < clusterCount ? boundaries[c + 1] : triangleCount;
+		output.insert(output.end(), indices.begin() + boundaries[c] * 3, indices.begin() + end * 3);
+	}
+
+	indices.swap(output);
+}
+
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+	std::vector<Vertex> output;
+	output.reserve(vertices.size());
+
+	for (uint32_t& index : indices)
+	{
+		if (remap[index] == UINT32_MAX)
+		{
+			remap[index] = static_cast<uint32_t>(output.size());
+			output.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	vertices.swap(output);
+}
@@ -0,0 +1,305 @@
+#include "MeshSimplifier.h"
+#include "Bounds.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+#include <glm/gtx/hash.hpp>
+
+namespace
+{
+	// Symmetric 4x4 plane quadric with the total area it was built from, the error of a point
+	// divided by the weight is a mean squared distance to the accumulated planes
+	struct Quadric
+	{
+		double a00, a11, a22, a01, a02, a12;
+		double b0, b1, b2;
+		double c;
+		double weight;
+
+		void AddPlane(const glm::dvec3& normal, double distance, double area)
+		{
+			a00 += area * normal.x * normal.x;
+			a11 += area * normal.y * normal.y;
+			a22 += area * normal.z * normal.z;
+			a01 += area * normal.x * normal.y;
+			a02 += area * normal.x * normal.z;
+			a12 += area * normal.y * normal.z;
+			b0 += area * normal.x * distance;
+			b1 += area * normal.y * distance;
+			b2 += area * normal.z * distance;
+			c += area * distance * distance;
+			weight += area;
+		}
+
+		void Add(const Quadric& other)
+		{
+			a00 += other.a00; a11 += other.a11; a22 += other.a22;
+			a01 += other.a01; a02 += other.a02; a12 += other.a12;
+			b0 += other.b0; b1 += other.b1; b2 += other.b2;
+			c += other.c;
+			weight += other.weight;
+		}
+
+		double Error(const glm::dvec3& p) const
+		{
+			double error = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z +
+				2.0 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z) +
+				2.0 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+
+			return weight > 0.0 ? std::max(error, 0.0) / weight : 0.0;
+		}
+	};
+
+	struct Collapse
+	{
+		uint32_t	source;
+		uint32_t	target;
+		double		error;
+	};
+
+	inline uint64_t EdgeKey(uint32_t a, uint32_t b)
+	{
+		return (static_cast<uint64_t>(a) << 32) | b;
+	}
+}
+
+float SimplifyMesh(std::vector<uint32_t>& destination, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+	size_t targetIndexCount, float maxError)
+{
+	const uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+	destination = indices;
+
+	// Work in a unit box so the quadrics keep their precision whatever the mesh scale
+	Bounds bounds;
+	for (const Vertex& vertex : vertices)
+		bounds.Extend(vertex.pos);
+
+	const glm::vec3 extent = bounds.GetExtent();
+	const double scale = std::max(extent.x, std::max(extent.y, extent.z));
+	if (vertices.empty() || scale <= 0.0)
+		return 0.0f;
+
+	std::vector<glm::dvec3> positions(vertexCount);
+	for (uint32_t v = 0; v < vertexCount; ++v)
+		positions[v] = glm::dvec3(vertices[v].pos - bounds.min) / scale;
+
+	// Every vertex sharing a position maps to the first one, topology is built on those
+	std::vector<uint32_t> remap(vertexCount);
+	std::vector<uint32_t> wedgeCount(vertexCount, 0);
+	{
+		std::unordered_map<glm::vec3, uint32_t> firstAtPosition;
+		firstAtPosition.reserve(vertexCount);
+		for (uint32_t v = 0; v < vertexCount; ++v)
+		{
+			remap[v] = firstAtPosition.emplace(vertices[v].pos, v).first->second;
+			wedgeCount[remap[v]]++;
+		}
+	}
+
+	// Borders have a directed edge without its reverse, non manifold edges appear twice the same way
+	std::vector<uint8_t> locked(vertexCount, 0);
+	{
+		std::vector<uint64_t> edges;
+		edges.reserve(indices.size());
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				uint32_t a = remap[indices[i + k]];
+				uint32_t b = remap[indices[i + (k + 1) % 3]];
+				if (a != b)
+					edges.push_back(EdgeKey(a, b));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+
+		for (size_t e = 0; e < edges.size(); ++e)
+		{
+			uint32_t a = static_cast<uint32_t>(edges[e] >> 32);
+			uint32_t b = static_cast<uint32_t>(edges[e]);
+
+			bool duplicate = e + 1 < edges.size() && edges[e + 1] == edges[e];
+			if (duplicate || !std::binary_search(edges.begin(), edges.end(), EdgeKey(b, a)))
+				locked[a] = locked[b] = 1;
+		}
+
+		for (uint32_t v = 0; v < vertexCount; ++v)
+		{
+			if (wedgeCount[remap[v]] > 1)
+				locked[remap[v]] = 1;
+		}
+	}
+
+	std::vector<Quadric> quadrics(vertexCount, Quadric{});
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		uint32_t v0 = remap[indices[i]], v1 = remap[indices[i + 1]], v2 = remap[indices[i + 2]];
+
+		glm::dvec3 normal = glm::cross(positions[v1] - positions[v0], positions[v2] - positions[v0]);
+		double length = glm::length(normal);
+		if (length <= 0.0)
+			continue;
+
+		normal /= length;
+		double distance = -glm::dot(normal, positions[v0]);
+		quadrics[v0].AddPlane(normal, distance, length * 0.5);
+		quadrics[v1].AddPlane(normal, distance, length * 0.5);
+		quadrics[v2].AddPlane(normal, distance, length * 0.5);
+	}
+
+	const double errorLimit = static_cast<double>(maxError) / scale;
+	const double errorLimitSquared = maxError == FLT_MAX ? DBL_MAX : errorLimit * errorLimit;
+	double resultError = 0.0;
+
+	std::vector<uint32_t> offsets(vertexCount + 1);
+	std::vector<uint32_t> adjacency;
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> collapseTarget(vertexCount);
+	std::vector<uint8_t> touched(vertexCount);
+
+	while (destination.size() > targetIndexCount)
+	{
+		const size_t triangleCount = destination.size() / 3;
+
+		// Vertex to triangle adjacency on the current index buffer
+		std::fill(offsets.begin(), offsets.end(), 0);
+		for (uint32_t index : destination)
+			offsets[remap[index] + 1]++;
+		for (uint32_t v = 0; v < vertexCount; ++v)
+			offsets[v + 1] += offsets[v];
+
+		adjacency.resize(destination.size());
+		{
+			std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < destination.size(); ++i)
+				adjacency[fill[remap[destination[i]]]++] = static_cast<uint32_t>(i / 3);
+		}
+
+		// Cheapest collapse of every free vertex onto one of its neighbours
+		collapses.clear();
+		for (uint32_t v = 0; v < vertexCount; ++v)
+		{
+			if (locked[v] || remap[v] != v || offsets[v] == offsets[v + 1])
+				continue;
+
+			Collapse best = { v, v, DBL_MAX };
+			for (uint32_t a = offsets[v]; a < offsets[v + 1]; ++a)
+			{
+				const uint32_t* triangle = &destination[adjacency[a] * 3];
+				for (int k = 0; k < 3; ++k)
+				{
+					uint32_t target = remap[triangle[k]];
+					if (target == v)
+						continue;
+
+					Quadric quadric = quadrics[v];
+					quadric.Add(quadrics[target]);
+					double error = quadric.Error(positions[target]);
+					if (error < best.error)
+						best = { v, target, error };
+				}
+			}
+
+			if (best.target != v && best.error <= errorLimitSquared)
+				collapses.push_back(best);
+		}
+
+		if (collapses.empty())
+			break;
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+		// Apply the cheapest independent collapses, each one removes about two triangles
+		const size_t collapseGoal = (triangleCount - targetIndexCount / 3) / 2 + 1;
+		size_t collapseCount = 0;
+
+		std::fill(touched.begin(), touched.end(), 0);
+		for (uint32_t v = 0; v < vertexCount; ++v)
+			collapseTarget[v] = v;
+
+		for (const Collapse& collapse : collapses)
+		{
+			if (collapseCount >= collapseGoal)
+				break;
+
+			const uint32_t source = collapse.source;
+			const uint32_t target = collapse.target;
+			if (touched[source] || touched[target])
+				continue;
+
+			// The corners of target next to source must agree on one vertex to take over source's
+			// corners, and moving source onto target must not flip any remaining triangle
+			uint32_t targetVertex = UINT32_MAX;
+			bool valid = true;
+			for (uint32_t a = offsets[source]; a < offsets[source + 1] && valid; ++a)
+			{
+				const uint32_t* triangle = &destination[adjacency[a] * 3];
+
+				int sourceCorner = 0;
+				bool hasTarget = false;
+				for (int k = 0; k < 3; ++k)
+				{
+					if (remap[triangle[k]] == source)
+						sourceCorner = k;
+					else if (remap[triangle[k]] == target)
+					{
+						hasTarget = true;
+						if (targetVertex != UINT32_MAX && targetVertex != triangle[k])
+							valid = false;
+						targetVertex = triangle[k];
+					}
+				}
+
+				if (hasTarget)
+					continue;
+
+				const glm::dvec3& p1 = positions[remap[triangle[(sourceCorner + 1) % 3]]];
+				const glm::dvec3& p2 = positions[remap[triangle[(sourceCorner + 2) % 3]]];
+				glm::dvec3 before = glm::cross(p1 - positions[source], p2 - positions[source]);
+				glm::dvec3 after = glm::cross(p1 - positions[target], p2 - positions[target]);
+				if (glm::dot(before, after) <= 0.0)
+					valid = false;
+			}
+
+			if (!valid || targetVertex == UINT32_MAX)
+				continue;
+
+			collapseTarget[source] = targetVertex;
+			quadrics[target].Add(quadrics[source]);
+			resultError = std::max(resultError, collapse.error);
+			collapseCount++;
+
+			// Everything around source changes, keep this pass' adjacency valid for the rest
+			for (uint32_t a = offsets[source]; a < offsets[source + 1]; ++a)
+			{
+				const uint32_t* triangle = &destination[adjacency[a] * 3];
+				for (int k = 0; k < 3; ++k)
+					touched[remap[triangle[k]]] = 1;
+			}
+		}
+
+		if (collapseCount == 0)
+			break;
+
+		// Rewrite corners and drop the triangles that became degenerate
+		size_t write = 0;
+		for (size_t i = 0; i + 2 < destination.size(); i += 3)
+		{
+			uint32_t i0 = collapseTarget[destination[i]];
+			uint32_t i1 = collapseTarget[destination[i + 1]];
+			uint32_t i2 = collapseTarget[destination[i + 2]];
+
+			if (remap[i0] == remap[i1] || remap[i1] == remap[i2] || remap[i0] == remap[i2])
+				continue;
+
+			destination[write++] = i0;
+			destination[write++] = i1;
+			destination[write++] = i2;
+		}
+		destination.resize(write);
+	}
+
+	return static_cast<float>(std::sqrt(resultError) * scale);
+}
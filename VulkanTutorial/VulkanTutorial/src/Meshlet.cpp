@@ -0,0 +1,107 @@
+#include "Meshlet.h"
+#include "Bounds.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Cones wider than this (dot of the axis with the farthest normal) are not worth testing
+#define MESHLET_CONE_MIN_DOT 0.1f
+
+static void ComputeMeshletBounds(Meshlet& meshlet, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+{
+	Bounds bounds;
+	for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; ++i)
+		bounds.Extend(vertices[indices[i]].pos);
+
+	glm::vec3 center = bounds.GetCenter();
+	float radius = 0.0f;
+	for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; ++i)
+		radius = std::max(radius, glm::length(vertices[indices[i]].pos - center));
+
+	meshlet.sphere = glm::vec4(center, radius);
+	meshlet.aabbMin = glm::vec4(bounds.min, 0.0f);
+	meshlet.aabbMax = glm::vec4(bounds.max, 0.0f);
+
+	// Cone axis: average of the unit triangle normals, its spread is the farthest normal
+	glm::vec3 axis(0.0f);
+	for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3)
+	{
+		const glm::vec3& p0 = vertices[indices[i + 0]].pos;
+		glm::vec3 normal = glm::cross(vertices[indices[i + 1]].pos - p0, vertices[indices[i + 2]].pos - p0);
+		float length = glm::length(normal);
+		if (length > 0.0f)
+			axis += normal / length;
+	}
+
+	meshlet.coneApex = glm::vec4(center, 0.0f);
+	meshlet.coneAxis = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+	float axisLength = glm::length(axis);
+	if (axisLength <= 0.0f)
+		return;
+	axis /= axisLength;
+
+	float minDot = 1.0f;
+	float maxT = 0.0f;
+	for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3)
+	{
+		const glm::vec3& p0 = vertices[indices[i + 0]].pos;
+		glm::vec3 normal = glm::cross(vertices[indices[i + 1]].pos - p0, vertices[indices[i + 2]].pos - p0);
+		float length = glm::length(normal);
+		if (length <= 0.0f)
+			continue;
+		normal /= length;
+
+		float dot = glm::dot(axis, normal);
+		minDot = std::min(minDot, dot);
+		if (dot <= MESHLET_CONE_MIN_DOT)
+			return;
+
+		// Move the apex back along the axis until it is behind every triangle plane
+		maxT = std::max(maxT, glm::dot(center - p0, normal) / dot);
+	}
+
+	meshlet.coneApex = glm::vec4(center - axis * maxT, 0.0f);
+	meshlet.coneAxis = glm::vec4(axis, std::sqrt(1.0f - minDot * minDot));
+}
+
+void BuildMeshlets(std::vector<Meshlet>& meshlets, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+	uint32_t maxVertices, uint32_t maxTriangles)
+{
+	meshlets.clear();
+
+	// marks[v] == meshlets.size() + 1 while vertex v is part of the meshlet being built
+	std::vector<uint32_t> marks(vertices.size(), 0);
+
+	Meshlet current = {};
+	for (uint32_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		uint32_t mark = static_cast<uint32_t>(meshlets.size()) + 1;
+
+		// Degenerate triangles are counted once per corner, which only makes the limit conservative
+		uint32_t newVertices = (marks[indices[i]] != mark) + (marks[indices[i + 1]] != mark) + (marks[indices[i + 2]] != mark);
+		if (current.vertexCount + newVertices > maxVertices || current.indexCount / 3 + 1 > maxTriangles)
+		{
+			meshlets.push_back(current);
+			current = {};
+			current.firstIndex = i;
+			mark++;
+		}
+
+		for (uint32_t k = i; k < i + 3; ++k)
+		{
+			if (marks[indices[k]] != mark)
+			{
+				marks[indices[k]] = mark;
+				current.vertexCount++;
+			}
+		}
+		current.indexCount += 3;
+	}
+
+	if (current.indexCount > 0)
+		meshlets.push_back(current);
+
+	for (Meshlet& meshlet : meshlets)
+		ComputeMeshletBounds(meshlet, vertices, indices);
+}
@@ -0,0 +1,111 @@
+#include "MipGenerator.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_GENERATOR_SSE2
+#include <emmintrin.h>
+#endif
+
+// Destination rows handled by one task
+#define MIP_ROWS_PER_TASK 64
+
+uint32_t GetMipLevelCount(uint32_t width, uint32_t height)
+{
+	uint32_t levels = 1;
+	for (uint32_t size = std::max(width, height); size > 1; size >>= 1)
+		levels++;
+
+	return levels;
+}
+
+// Averages the 2x2 source texels of each destination texel of one row, a source column or row
+// past the edge (odd sizes, 1 pixel wide levels) is clamped to the last one
+static void DownsampleRow(const unsigned char* row0, const unsigned char* row1, unsigned char* destination,
+	uint32_t srcWidth, uint32_t dstWidth)
+{
+	uint32_t x = 0;
+
+#ifdef MIP_GENERATOR_SSE2
+	// Two destination texels per iteration: 4 source texels from each row
+	if (srcWidth >= 2)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i rounding = _mm_set1_epi16(2);
+
+		for (; x + 2 <= dstWidth && 2 * x + 4 <= srcWidth; x += 2)
+		{
+			__m128i top = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 8 * x));
+			__m128i bottom = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 8 * x));
+
+			// 16-bit lanes: [t0 t1] [t2 t3] per half, summed vertically then horizontally
+			__m128i low = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+			__m128i high = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+
+			__m128i lowSum = _mm_add_epi16(low, _mm_srli_si128(low, 8));
+			__m128i highSum = _mm_add_epi16(high, _mm_srli_si128(high, 8));
+			__m128i sum = _mm_unpacklo_epi64(lowSum, highSum);
+
+			sum = _mm_srli_epi16(_mm_add_epi16(sum, rounding), 2);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(destination + 4 * x), _mm_packus_epi16(sum, zero));
+		}
+	}
+#endif
+
+	for (; x < dstWidth; ++x)
+	{
+		uint32_t x0 = std::min(2 * x, srcWidth - 1);
+		uint32_t x1 = std::min(2 * x + 1, srcWidth - 1);
+
+		for (uint32_t c = 0; c < 4; ++c)
+		{
+			uint32_t sum = row0[4 * x0 + c] + row0[4 * x1 + c] + row1[4 * x0 + c] + row1[4 * x1 + c];
+			destination[4 * x + c] = static_cast<unsigned char>((sum + 2) >> 2);
+		}
+	}
+}
+
+void GenerateMipChain(const unsigned char* pixels, uint32_t width, uint32_t height,
+	std::vector<unsigned char>& output, std::vector<MipLevel>& levels)
+{
+	const uint32_t levelCount = GetMipLevelCount(width, height);
+
+	levels.resize(levelCount);
+	size_t size = 0;
+	for (uint32_t level = 0; level < levelCount; ++level)
+	{
+		levels[level].offset = size;
+		levels[level].width = std::max(1u, width >> level);
+		levels[level].height = std::max(1u, height >> level);
+		size += static_cast<size_t>(levels[level].width) * levels[level].height * 4;
+	}
+
+	output.resize(size);
+	memcpy(output.data(), pixels, static_cast<size_t>(width) * height * 4);
+
+	for (uint32_t level = 1; level < levelCount; ++level)
+	{
+		const MipLevel& source = levels[level - 1];
+		const MipLevel& destination = levels[level];
+		const unsigned char* sourceData = output.data() + source.offset;
+		unsigned char* destinationData = output.data() + destination.offset;
+
+		size_t taskCount = (destination.height + MIP_ROWS_PER_TASK - 1) / MIP_ROWS_PER_TASK;
+		ThreadPool::Get().ParallelFor(taskCount, [&](size_t task)
+		{
+			uint32_t first = static_cast<uint32_t>(task * MIP_ROWS_PER_TASK);
+			uint32_t last = std::min(first + MIP_ROWS_PER_TASK, destination.height);
+
+			for (uint32_t y = first; y < last; ++y)
+			{
+				uint32_t y0 = std::min(2 * y, source.height - 1);
+				uint32_t y1 = std::min(2 * y + 1, source.height - 1);
+
+				DownsampleRow(sourceData + static_cast<size_t>(y0) * source.width * 4, sourceData + static_cast<size_t>(y1) * source.width * 4,
+					destinationData + static_cast<size_t>(y) * destination.width * 4, source.width, destination.width);
+			}
+		});
+	}
+}
@@ -0,0 +1,391 @@
+#include "ObjParser.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#define OBJ_MIN_CHUNK_SIZE (1 << 20)
+
+namespace
+{
+	struct ObjChunk
+	{
+		std::vector<float>		positions;
+		std::vector<float>		normals;
+		std::vector<float>		texCoords;
+		std::vector<ObjIndex>	indices;
+		std::vector<ObjShape>	shapes;
+
+		// Corners whose attribute was written with a negative (relative) index, their value
+		// is relative to the chunk start until the chunk offsets are known
+		std::vector<uint32_t>	relativeVertices;
+		std::vector<uint32_t>	relativeNormals;
+		std::vector<uint32_t>	relativeTexCoords;
+	};
+
+	const double POWERS_OF_TEN[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	inline bool IsDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	inline bool IsSpace(char c)
+	{
+		return c == ' ' || c == '\t';
+	}
+
+	inline bool IsEndOfLine(char c)
+	{
+		return c == '\n' || c == '\r';
+	}
+
+	inline const char* SkipSpaces(const char* p, const char* end)
+	{
+		while (p < end && IsSpace(*p))
+			++p;
+		return p;
+	}
+
+	inline const char* SkipLine(const char* p, const char* end)
+	{
+		while (p < end && *p != '\n')
+			++p;
+		return p < end ? p + 1 : p;
+	}
+
+	// Decimal to float without locale or stream overhead, exact for up to 19 significant digits
+	// and powers of ten that fit a double, which covers everything exporters write
+	const char* ParseFloat(const char* p, const char* end, float& value)
+	{
+		p = SkipSpaces(p, end);
+
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p == '-';
+			++p;
+		}
+
+		uint64_t mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+
+		for (; p < end && IsDigit(*p); ++p)
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+				digits += mantissa != 0;
+			}
+			else
+				++exponent;
+		}
+
+		if (p < end && *p == '.')
+		{
+			for (++p; p < end && IsDigit(*p); ++p)
+			{
+				if (digits < 19)
+				{
+					mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+					digits += mantissa != 0;
+					--exponent;
+				}
+			}
+		}
+
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			++p;
+			bool negativeExponent = false;
+			if (p < end && (*p == '-' || *p == '+'))
+			{
+				negativeExponent = *p == '-';
+				++p;
+			}
+
+			int e = 0;
+			for (; p < end && IsDigit(*p); ++p)
+				e = std::min(e * 10 + (*p - '0'), 1000);
+
+			exponent += negativeExponent ? -e : e;
+		}
+
+		double result = static_cast<double>(mantissa);
+		if (exponent < 0)
+			result = exponent >= -22 ? result / POWERS_OF_TEN[-exponent] : result * std::pow(10.0, exponent);
+		else if (exponent > 0)
+			result = exponent <= 22 ? result * POWERS_OF_TEN[exponent] : result * std::pow(10.0, exponent);
+
+		value = static_cast<float>(negative ? -result : result);
+		return p;
+	}
+
+	const char* ParseInt(const char* p, const char* end, int& value)
+	{
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p == '-';
+			++p;
+		}
+
+		int result = 0;
+		for (; p < end && IsDigit(*p); ++p)
+			result = result * 10 + (*p - '0');
+
+		value = negative ? -result : result;
+		return p;
+	}
+
+	// Converts an OBJ index (1 based, or negative relative to the current count) to a zero based
+	// index, returns true when the result is relative to the chunk start
+	inline bool ResolveIndex(int raw, int count, int& index)
+	{
+		if (raw < 0)
+		{
+			index = count + raw;
+			return true;
+		}
+
+		index = raw - 1;
+		return false;
+	}
+
+	void ParseChunk(const char* p, const char* end, ObjChunk& chunk)
+	{
+		std::vector<ObjIndex> face;
+		std::vector<uint8_t> faceRelative;
+
+		while (p < end)
+		{
+			p = SkipSpaces(p, end);
+			if (p >= end)
+				break;
+
+			if (p[0] == 'v' && p + 1 < end)
+			{
+				if (IsSpace(p[1]))
+				{
+					float x, y, z;
+					p = ParseFloat(p + 2, end, x);
+					p = ParseFloat(p, end, y);
+					p = ParseFloat(p, end, z);
+					chunk.positions.insert(chunk.positions.end(), { x, y, z });
+				}
+				else if (p[1] == 'n' && p + 2 < end && IsSpace(p[2]))
+				{
+					float x, y, z;
+					p = ParseFloat(p + 3, end, x);
+					p = ParseFloat(p, end, y);
+					p = ParseFloat(p, end, z);
+					chunk.normals.insert(chunk.normals.end(), { x, y, z });
+				}
+				else if (p[1] == 't' && p + 2 < end && IsSpace(p[2]))
+				{
+					float u, v = 0.0f;
+					p = ParseFloat(p + 3, end, u);
+					p = SkipSpaces(p, end);
+					if (p < end && !IsEndOfLine(*p))
+						p = ParseFloat(p, end, v);
+					chunk.texCoords.insert(chunk.texCoords.end(), { u, v });
+				}
+			}
+			else if (p[0] == 'f' && p + 1 < end && IsSpace(p[1]))
+			{
+				int vertexCount = static_cast<int>(chunk.positions.size() / 3);
+				int normalCount = static_cast<int>(chunk.normals.size() / 3);
+				int texCoordCount = static_cast<int>(chunk.texCoords.size() / 2);
+
+				face.clear();
+				faceRelative.clear();
+
+				p = SkipSpaces(p + 2, end);
+				while (p < end && !IsEndOfLine(*p) && *p != '#')
+				{
+					ObjIndex corner = { -1, -1, -1 };
+					uint8_t relative = 0;
+					int raw;
+
+					// Continued lines could span chunks, and anything else that is not an index would never be consumed
+					if (*p == '\\')
+						throw std::runtime_error("obj line continuations are not supported");
+
+					const char* start = p;
+					p = ParseInt(p, end, raw);
+					if (p == start)
+						throw std::runtime_error("obj face has an invalid character");
+					relative |= ResolveIndex(raw, vertexCount, corner.vertex) ? 1 : 0;
+
+					if (p < end && *p == '/')
+					{
+						++p;
+						if (p < end && *p != '/')
+						{
+							p = ParseInt(p, end, raw);
+							relative |= ResolveIndex(raw, texCoordCount, corner.texCoord) ? 2 : 0;
+						}
+						if (p < end && *p == '/')
+						{
+							p = ParseInt(p + 1, end, raw);
+							relative |= ResolveIndex(raw, normalCount, corner.normal) ? 4 : 0;
+						}
+					}
+
+					face.push_back(corner);
+					faceRelative.push_back(relative);
+					p = SkipSpaces(p, end);
+				}
+
+				// Triangle fan, same as tinyobj's default triangulation
+				for (size_t i = 1; i + 1 < face.size(); ++i)
+				{
+					const size_t corners[3] = { 0, i, i + 1 };
+					for (size_t corner : corners)
+					{
+						uint32_t position = static_cast<uint32_t>(chunk.indices.size());
+						if (faceRelative[corner] & 1)
+							chunk.relativeVertices.push_back(position);
+						if (faceRelative[corner] & 2)
+							chunk.relativeTexCoords.push_back(position);
+						if (faceRelative[corner] & 4)
+							chunk.relativeNormals.push_back(position);
+						chunk.indices.push_back(face[corner]);
+					}
+				}
+			}
+			else if ((p[0] == 'o' || p[0] == 'g') && p + 1 < end && IsSpace(p[1]))
+			{
+				const char* nameBegin = SkipSpaces(p + 2, end);
+				const char* nameEnd = nameBegin;
+				while (nameEnd < end && !IsEndOfLine(*nameEnd))
+					++nameEnd;
+				while (nameEnd > nameBegin && IsSpace(nameEnd[-1]))
+					--nameEnd;
+
+				chunk.shapes.push_back({ std::string(nameBegin, nameEnd), static_cast<uint32_t>(chunk.indices.size()), 0 });
+			}
+
+			p = SkipLine(p, end);
+		}
+	}
+
+	void FixIndices(std::vector<ObjIndex>& indices, const std::vector<uint32_t>& corners, int ObjIndex::* member, int offset)
+	{
+		for (uint32_t corner : corners)
+			indices[corner].*member += offset;
+	}
+
+	void CheckIndices(const ObjIndex* indices, size_t count, int vertexCount, int normalCount, int texCoordCount)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (indices[i].vertex < 0 || indices[i].vertex >= vertexCount ||
+				indices[i].normal < -1 || indices[i].normal >= normalCount ||
+				indices[i].texCoord < -1 || indices[i].texCoord >= texCoordCount)
+				throw std::runtime_error("obj face references an attribute out of range");
+		}
+	}
+}
+
+ObjParser& ObjParser::Parse(const char* file)
+{
+	MappedFile mapping;
+	if (!mapping.Open(file))
+		throw std::runtime_error(std::string("failed to open obj file ") + file);
+
+	const char* data = reinterpret_cast<const char*>(mapping.GetData());
+	const size_t size = mapping.GetSize();
+
+	ThreadPool& pool = ThreadPool::Get();
+
+	// A few chunks per thread so an unlucky split (long comment blocks, huge faces) balances out
+	size_t chunkCount = std::max<size_t>(1, std::min<size_t>((pool.GetThreadCount() + 1) * 4, size / OBJ_MIN_CHUNK_SIZE));
+	std::vector<const char*> boundaries(chunkCount + 1);
+	boundaries[0] = data;
+	boundaries[chunkCount] = data + size;
+	for (size_t i = 1; i < chunkCount; ++i)
+	{
+		const char* split = std::max(data + size * i / chunkCount, boundaries[i - 1]);
+		boundaries[i] = SkipLine(split, data + size);
+	}
+
+	std::vector<ObjChunk> chunks(chunkCount);
+	pool.ParallelFor(chunkCount, [&](size_t i)
+	{
+		if (boundaries[i] < boundaries[i + 1])
+			ParseChunk(boundaries[i], boundaries[i + 1], chunks[i]);
+	});
+
+	// Prefix sums give every chunk its place in the merged arrays
+	struct ChunkOffsets { size_t positions, normals, texCoords, indices; };
+	std::vector<ChunkOffsets> offsets(chunkCount + 1);
+	offsets[0] = { 0, 0, 0, 0 };
+	for (size_t i = 0; i < chunkCount; ++i)
+	{
+		offsets[i + 1].positions = offsets[i].positions + chunks[i].positions.size();
+		offsets[i + 1].normals = offsets[i].normals + chunks[i].normals.size();
+		offsets[i + 1].texCoords = offsets[i].texCoords + chunks[i].texCoords.size();
+		offsets[i + 1].indices = offsets[i].indices + chunks[i].indices.size();
+	}
+
+	_positions.resize(offsets[chunkCount].positions);
+	_normals.resize(offsets[chunkCount].normals);
+	_texCoords.resize(offsets[chunkCount].texCoords);
+	_indices.resize(offsets[chunkCount].indices);
+
+	const int vertexCount = static_cast<int>(_positions.size() / 3);
+	const int normalCount = static_cast<int>(_normals.size() / 3);
+	const int texCoordCount = static_cast<int>(_texCoords.size() / 2);
+
+	pool.ParallelFor(chunkCount, [&](size_t i)
+	{
+		ObjChunk& chunk = chunks[i];
+		const ChunkOffsets& offset = offsets[i];
+
+		FixIndices(chunk.indices, chunk.relativeVertices, &ObjIndex::vertex, static_cast<int>(offset.positions / 3));
+		FixIndices(chunk.indices, chunk.relativeNormals, &ObjIndex::normal, static_cast<int>(offset.normals / 3));
+		FixIndices(chunk.indices, chunk.relativeTexCoords, &ObjIndex::texCoord, static_cast<int>(offset.texCoords / 2));
+
+		std::copy(chunk.positions.begin(), chunk.positions.end(), _positions.begin() + offset.positions);
+		std::copy(chunk.normals.begin(), chunk.normals.end(), _normals.begin() + offset.normals);
+		std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), _texCoords.begin() + offset.texCoords);
+		std::copy(chunk.indices.begin(), chunk.indices.end(), _indices.begin() + offset.indices);
+
+		CheckIndices(chunk.indices.data(), chunk.indices.size(), vertexCount, normalCount, texCoordCount);
+
+		// Shapes are still needed below, the bulk data can go
+		chunk.positions = {};
+		chunk.normals = {};
+		chunk.texCoords = {};
+		chunk.indices = {};
+	});
+
+	// Faces before the first o/g statement go to an unnamed shape, empty shapes are dropped
+	std::vector<ObjShape> shapes = { { "", 0, 0 } };
+	for (size_t i = 0; i < chunkCount; ++i)
+	{
+		for (const ObjShape& shape : chunks[i].shapes)
+			shapes.push_back({ shape.name, static_cast<uint32_t>(shape.firstIndex + offsets[i].indices), 0 });
+	}
+
+	_shapes.clear();
+	for (size_t i = 0; i < shapes.size(); ++i)
+	{
+		uint32_t last = i + 1 < shapes.size() ? shapes[i + 1].firstIndex : static_cast<uint32_t>(_indices.size());
+		shapes[i].indexCount = last - shapes[i].firstIndex;
+		if (shapes[i].indexCount > 0)
+			_shapes.push_back(std::move(shapes[i]));
+	}
+
+	mapping.Close();
+
+	return *this;
+}
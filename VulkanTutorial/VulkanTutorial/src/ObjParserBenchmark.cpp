@@ -0,0 +1,56 @@
+#include "ObjParser.h"
+
+#ifdef OBJ_PARSER_BENCHMARK
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+// Build with OBJ_PARSER_BENCHMARK defined to run this instead of the renderer
+int RunObjParserBenchmark(const char* file, int iterations)
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	double tinyobjTime = 0.0;
+	double parserTime = 0.0;
+	size_t tinyobjIndices = 0;
+	size_t parserIndices = 0;
+
+	for (int i = 0; i < iterations; ++i)
+	{
+		auto start = Clock::now();
+
+		tinyobj::attrib_t attrib;
+		std::vector<tinyobj::shape_t> shapes;
+		std::vector<tinyobj::material_t> materials;
+		std::string warn, err;
+		if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, file))
+			throw std::runtime_error(warn + err);
+
+		tinyobjTime += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+		tinyobjIndices = 0;
+		for (const auto& shape : shapes)
+			tinyobjIndices += shape.mesh.indices.size();
+
+		start = Clock::now();
+
+		ObjParser parser;
+		parser.Parse(file);
+
+		parserTime += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		parserIndices = parser.GetIndices().size();
+	}
+
+	std::cout << file << " (" << iterations << " runs)" << std::endl;
+	std::cout << "tinyobj:   " << tinyobjTime / iterations << " ms, " << tinyobjIndices << " indices" << std::endl;
+	std::cout << "ObjParser: " << parserTime / iterations << " ms, " << parserIndices << " indices" << std::endl;
+	std::cout << "speedup:   " << tinyobjTime / parserTime << "x" << std::endl;
+
+	return tinyobjIndices == parserIndices ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#endif
@@ -12,7 +12,9 @@
 
 #include "Helpers.h"
 #include "Renderer.h"
+#include "StagingRing.h"
 #include "QueueFamilyIndices.h"
+#include "ThreadPool.h"
 
 namespace Application
 {
@@ -22,6 +24,11 @@ namespace Application
 		app->framebufferResized = true;
 	}
 
+	static uint32_t GetDrawGroup(const Mesh& mesh)
+	{
+		return mesh.GetVertexFormat() * 2 + (mesh.GetIndexType() == VK_INDEX_TYPE_UINT32 ? 1 : 0);
+	}
+
 	void Renderer::InitWindow()
 	{
 		if (glfwInit() == GLFW_FALSE)
@@ -41,13 +48,21 @@ namespace Application
 		CreateRenderPass();
 		CreateDescriptorSetLayout();
 		CreateGraphicsPipeline();
+		CreateCullPipeline();
 		CreateDepthResources();
 		CreateFramebuffers();
+		// Slot 0 of every texture array
+		CreatePlaceholderTexture();
 		CreateUniformBuffers();
 		CreateDescriptorPool();
 		CreateDescriptorSets();
-		CreateCommandBuffers();
+		CreateFrameCommands();
 		CreateSyncObjects();
+
+		_textureManager.Create(_context.physicalDevice);
+		_textureManager.EnableStreaming(TEXTURE_STREAMING_BUDGET);
+		_assetLoader.Create(_context, &_textureManager);
+		RequestScene();
 	}
 
 	void Renderer::CreateSwapChain()
@@ -186,21 +201,71 @@ namespace Application
 		uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 		uboLayoutBinding.pImmutableSamplers = nullptr; // Optional
 
+		VkDescriptorSetLayoutBinding objectLayoutBinding = {};
+		objectLayoutBinding.binding = 1;
+		objectLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		objectLayoutBinding.descriptorCount = 1;
+		objectLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		objectLayoutBinding.pImmutableSamplers = nullptr;
+
+		VkDescriptorSetLayoutBinding materialLayoutBinding = {};
+		materialLayoutBinding.binding = 2;
+		materialLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		materialLayoutBinding.descriptorCount = 1;
+		materialLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		materialLayoutBinding.pImmutableSamplers = nullptr;
+
+		// Every texture of the scene, materials index into it
 		VkDescriptorSetLayoutBinding samplerLayoutBinding = {};
-		samplerLayoutBinding.binding = 1;
-		samplerLayoutBinding.descriptorCount = 1;
+		samplerLayoutBinding.binding = 3;
+		samplerLayoutBinding.descriptorCount = MAX_BINDLESS_TEXTURES;
 		samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 		samplerLayoutBinding.pImmutableSamplers = nullptr;
 		samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-		std::array<VkDescriptorSetLayoutBinding, 2> bindings = { uboLayoutBinding, samplerLayoutBinding };
+		std::array<VkDescriptorSetLayoutBinding, 4> bindings = { uboLayoutBinding, objectLayoutBinding, materialLayoutBinding, samplerLayoutBinding };
+
+		// Unused slots may stay unwritten, and slots are written while the set is bound in recorded command buffers
+		std::array<VkDescriptorBindingFlagsEXT, 4> bindingFlags = {
+			0,
+			0,
+			0,
+			VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT
+		};
+
+		VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo = {};
+		bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+		bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+		bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+
 		VkDescriptorSetLayoutCreateInfo layoutInfo = {};
 		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.pNext = &bindingFlagsInfo;
+		layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
 		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
 		layoutInfo.pBindings = bindings.data();
 
 		if (vkCreateDescriptorSetLayout(_context.device, &layoutInfo, nullptr, &_descriptorSetLayout) != VK_SUCCESS)
 			throw std::runtime_error("failed to create descriptor set layout!");
+
+		// Cull pass: objects, cull objects, draw commands and draw counts, all storage buffers
+		std::array<VkDescriptorSetLayoutBinding, 4> cullBindings = {};
+		for (uint32_t i = 0; i < cullBindings.size(); ++i)
+		{
+			cullBindings[i].binding = i;
+			cullBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			cullBindings[i].descriptorCount = 1;
+			cullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+			cullBindings[i].pImmutableSamplers = nullptr;
+		}
+
+		VkDescriptorSetLayoutCreateInfo cullLayoutInfo = {};
+		cullLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		cullLayoutInfo.bindingCount = static_cast<uint32_t>(cullBindings.size());
+		cullLayoutInfo.pBindings = cullBindings.data();
+
+		if (vkCreateDescriptorSetLayout(_context.device, &cullLayoutInfo, nullptr, &_cullSetLayout) != VK_SUCCESS)
+			throw std::runtime_error("failed to create cull descriptor set layout!");
 	}
 
 	void Renderer::CreateGraphicsPipeline()
@@ -215,15 +280,6 @@ namespace Application
 		_shaders.push_back(fragmentShader);
 
 		VkPipelineShaderStageCreateInfo shaderStages[] = { vertexShader.GetInfo(), fragmentShader.GetInfo() };
-		
-		std::vector<VkPipelineVertexInputStateCreateInfo> vertexInfo;
-		Mesh* mesh = new Mesh;
-		mesh->LoadMesh("Media/fantasy_game_inn.obj", "Media/fantasy_game_inn_diffuse.png");
-		_meshes.push_back(mesh);
-		vertexInfo.push_back(mesh->GetInfo());
-
-		for (int i = 0; i < _meshes.size(); ++i)
-			_meshes[i]->CreateBuffers(_context);
 
 		VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
 		inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -318,18 +374,42 @@ namespace Application
 		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 		pipelineLayoutInfo.setLayoutCount = 1;
 		pipelineLayoutInfo.pSetLayouts = &_descriptorSetLayout;
-		pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-		pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
+		// Nothing per draw, the object comes from the draw's firstInstance
+		pipelineLayoutInfo.pushConstantRangeCount = 0;
+		pipelineLayoutInfo.pPushConstantRanges = nullptr;
 
 		if (vkCreatePipelineLayout(_context.device, &pipelineLayoutInfo, nullptr, &_pipelineLayout) != VK_SUCCESS)
 			throw std::runtime_error("failed to create pipeline layout!");
 
 
+		VkSpecializationMapEntry vertexFormatEntry = {};
+		vertexFormatEntry.constantID = 0;
+		vertexFormatEntry.offset = 0;
+		vertexFormatEntry.size = sizeof(uint32_t);
+
+		uint32_t vertexFormat = VERTEX_FORMAT_FLOAT;
+		VkSpecializationInfo specializationInfo = {};
+		specializationInfo.mapEntryCount = 1;
+		specializationInfo.pMapEntries = &vertexFormatEntry;
+		specializationInfo.dataSize = sizeof(vertexFormat);
+		specializationInfo.pData = &vertexFormat;
+		shaderStages[0].pSpecializationInfo = &specializationInfo;
+
+		VkVertexInputBindingDescription bindingDescription;
+		std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions;
+
+		VkPipelineVertexInputStateCreateInfo vertexInfo = {};
+		vertexInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		vertexInfo.vertexBindingDescriptionCount = 1;
+		vertexInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+		vertexInfo.pVertexBindingDescriptions = &bindingDescription;
+		vertexInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
 		VkGraphicsPipelineCreateInfo pipelineInfo = {};
 		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
 		pipelineInfo.stageCount = 2;
 		pipelineInfo.pStages = shaderStages;
-		pipelineInfo.pVertexInputState = vertexInfo.data();
+		pipelineInfo.pVertexInputState = &vertexInfo;
 		pipelineInfo.pInputAssemblyState = &inputAssembly;
 		pipelineInfo.pViewportState = &viewportState;
 		pipelineInfo.pRasterizationState = &rasterizer;
@@ -344,8 +424,51 @@ namespace Application
 		pipelineInfo.basePipelineIndex = -1; // Optional
 		pipelineInfo.pDepthStencilState = &depthStencil;
 
-		if (vkCreateGraphicsPipelines(_context.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_graphicsPipeline) != VK_SUCCESS)
-			throw std::runtime_error("failed to create graphics pipeline!");
+		for (uint32_t i = 0; i < VERTEX_FORMAT_COUNT; ++i)
+		{
+			vertexFormat = i;
+			bindingDescription = GetBindingDescription(static_cast<VertexFormat>(i));
+			attributeDescriptions = GetAttributeDescriptions(static_cast<VertexFormat>(i));
+
+			if (vkCreateGraphicsPipelines(_context.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_graphicsPipelines[i]) != VK_SUCCESS)
+				throw std::runtime_error("failed to create graphics pipeline!");
+		}
+	}
+
+	void Renderer::CreateCullPipeline()
+	{
+		Shader cullShader;
+		cullShader.CreateShader(_context.device, "Shader/cull.comp", shaderc_glsl_compute_shader, VK_SHADER_STAGE_COMPUTE_BIT, "main");
+		_shaders.push_back(cullShader);
+
+		VkPushConstantRange pushConstantRange = {};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(CullConstants);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &_cullSetLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		if (vkCreatePipelineLayout(_context.device, &pipelineLayoutInfo, nullptr, &_cullPipelineLayout) != VK_SUCCESS)
+			throw std::runtime_error("failed to create cull pipeline layout!");
+
+		VkComputePipelineCreateInfo pipelineInfo = {};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage = cullShader.GetInfo();
+		pipelineInfo.layout = _cullPipelineLayout;
+
+		if (vkCreateComputePipelines(_context.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_cullPipeline) != VK_SUCCESS)
+			throw std::runtime_error("failed to create cull pipeline!");
+	}
+
+	void Renderer::DestroyCullPipeline()
+	{
+		vkDestroyPipeline(_context.device, _cullPipeline, nullptr);
+		vkDestroyPipelineLayout(_context.device, _cullPipelineLayout, nullptr);
 	}
 
 	void Renderer::CreateFramebuffers()
@@ -406,7 +529,11 @@ namespace Application
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _depthImage, _depthImageMemory);
 		_depthImageView = CreateImageView(_depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
 
-		TransitionImageLayout(_context, _depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+		VkImageAspectFlags aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+		if (HasStencilComponent(depthFormat))
+			aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+
+		TransitionImageLayout(_context, _depthImage, aspect, RESOURCE_STATE_UNDEFINED, RESOURCE_STATE_DEPTH_ATTACHMENT);
 	}
 
 	VkImageView Renderer::CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags)
@@ -431,30 +558,118 @@ namespace Application
 
 	void Renderer::CreateUniformBuffers()
 	{
-		VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+		_frameUniformBuffers.resize(_swapChainImages.size());
+		_drawCountBuffers.resize(_swapChainImages.size());
+
+		for (size_t i = 0; i < _swapChainImages.size(); i++)
+		{
+			_frameUniformBuffers[i].CreateMappedBuffer(_context, sizeof(FrameUniforms), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+			_drawCountBuffers[i].CreateBuffer(_context, sizeof(uint32_t) * DRAW_GROUP_COUNT,
+				VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		}
+
+		CreateObjectBuffers();
+	}
+
+	void Renderer::CreateObjectBuffers()
+	{
+		_objectBuffers.resize(_swapChainImages.size());
+		_materialBuffers.resize(_swapChainImages.size());
+		_cullObjectBuffers.resize(_swapChainImages.size());
+		_drawCommandBuffers.resize(_swapChainImages.size());
 
-		for (int j = 0; j < _meshes.size(); ++j)
+		for (size_t i = 0; i < _swapChainImages.size(); i++)
 		{
-			_meshes[j]->GetUniformBuffer().resize(_swapChainImages.size());
+			_objectBuffers[i].CreateMappedBuffer(_context, sizeof(ObjectData) * _objectCapacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+			_materialBuffers[i].CreateMappedBuffer(_context, sizeof(MaterialData) * _objectCapacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+			_cullObjectBuffers[i].CreateMappedBuffer(_context, sizeof(CullObject) * _objectCapacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+			// Only the GPU writes the draws
+			_drawCommandBuffers[i].CreateBuffer(_context, sizeof(VkDrawIndexedIndirectCommand) * _objectCapacity * DRAW_GROUP_COUNT,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		}
+	}
 
-			for (size_t i = 0; i < _swapChainImages.size(); i++)
-				_meshes[j]->GetUniformBuffer()[i].CreateBuffer(_context, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	void Renderer::DestroyObjectBuffers()
+	{
+		for (size_t i = 0; i < _objectBuffers.size(); i++)
+		{
+			_objectBuffers[i].Destroy(_context.device);
+			_materialBuffers[i].Destroy(_context.device);
+			_cullObjectBuffers[i].Destroy(_context.device);
+			_drawCommandBuffers[i].Destroy(_context.device);
 		}
 	}
 
+	void Renderer::WriteObjectDescriptors()
+	{
+		for (uint32_t i = 0; i < _swapChainImages.size(); i++)
+		{
+			VkDescriptorBufferInfo objectInfo = { _objectBuffers[i].GetBuffer(), 0, sizeof(ObjectData) * _objectCapacity };
+			VkDescriptorBufferInfo materialInfo = { _materialBuffers[i].GetBuffer(), 0, sizeof(MaterialData) * _objectCapacity };
+			VkDescriptorBufferInfo cullObjectInfo = { _cullObjectBuffers[i].GetBuffer(), 0, sizeof(CullObject) * _objectCapacity };
+			VkDescriptorBufferInfo commandInfo = { _drawCommandBuffers[i].GetBuffer(), 0, VK_WHOLE_SIZE };
+			VkDescriptorBufferInfo countInfo = { _drawCountBuffers[i].GetBuffer(), 0, VK_WHOLE_SIZE };
+
+			// Objects and materials of the graphics set, every binding of the cull set
+			const std::array<std::pair<VkDescriptorSet, uint32_t>, 6> targets = { {
+				{ _descriptorSets[i], 1 }, { _descriptorSets[i], 2 },
+				{ _cullDescriptorSets[i], 0 }, { _cullDescriptorSets[i], 1 }, { _cullDescriptorSets[i], 2 }, { _cullDescriptorSets[i], 3 } } };
+			const std::array<VkDescriptorBufferInfo*, 6> bufferInfos = { &objectInfo, &materialInfo, &objectInfo, &cullObjectInfo, &commandInfo, &countInfo };
+
+			std::array<VkWriteDescriptorSet, 6> descriptorWrites = {};
+			for (uint32_t j = 0; j < descriptorWrites.size(); ++j)
+			{
+				descriptorWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				descriptorWrites[j].dstSet = targets[j].first;
+				descriptorWrites[j].dstBinding = targets[j].second;
+				descriptorWrites[j].dstArrayElement = 0;
+				descriptorWrites[j].descriptorCount = 1;
+				descriptorWrites[j].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				descriptorWrites[j].pBufferInfo = bufferInfos[j];
+			}
+
+			vkUpdateDescriptorSets(_context.device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+		}
+	}
+
+	void Renderer::GrowObjectBuffers(size_t count)
+	{
+		if (count <= _objectCapacity)
+			return;
+
+		// Rare, capacity doubles, so waiting for every frame in flight to release the old buffers is cheaper
+		// than keeping them alive per image
+		{
+			std::lock_guard<std::mutex> lock(*_context.queueMutex);
+			vkDeviceWaitIdle(_context.device);
+		}
+
+		while (_objectCapacity < count)
+			_objectCapacity *= 2;
+
+		DestroyObjectBuffers();
+		CreateObjectBuffers();
+		WriteObjectDescriptors();
+	}
+
 	void Renderer::CreateDescriptorPool()
 	{
-		std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+		// One set per swapchain image whatever the number of meshes
+		std::array<VkDescriptorPoolSize, 3> poolSizes = {};
 		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		poolSizes[0].descriptorCount = static_cast<uint32_t>(_swapChainImages.size()) * _meshes.size();
-		poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		poolSizes[1].descriptorCount = static_cast<uint32_t>(_swapChainImages.size()) * _meshes.size();
+		poolSizes[0].descriptorCount = static_cast<uint32_t>(_swapChainImages.size());
+		poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		// Objects and materials, and the 4 buffers of the cull set
+		poolSizes[1].descriptorCount = static_cast<uint32_t>(_swapChainImages.size()) * (2 + 4);
+		poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		poolSizes[2].descriptorCount = static_cast<uint32_t>(_swapChainImages.size()) * MAX_BINDLESS_TEXTURES;
 
 		VkDescriptorPoolCreateInfo poolInfo = {};
 		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
 		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 		poolInfo.pPoolSizes = poolSizes.data();
-		poolInfo.maxSets = static_cast<uint32_t>(_swapChainImages.size()) * _meshes.size();
+		poolInfo.maxSets = static_cast<uint32_t>(_swapChainImages.size()) * 2;
 
 		if (vkCreateDescriptorPool(_context.device, &poolInfo, nullptr, &_descriptorPool) != VK_SUCCESS)
 			throw std::runtime_error("failed to create descriptor pool!");
@@ -462,114 +677,511 @@ namespace Application
 
 	void Renderer::CreateDescriptorSets()
 	{
-		std::vector<VkDescriptorSetLayout> layouts(_swapChainImages.size() , _descriptorSetLayout);
+		std::vector<VkDescriptorSetLayout> layouts(_swapChainImages.size(), _descriptorSetLayout);
 		VkDescriptorSetAllocateInfo allocInfo = {};
 		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 		allocInfo.descriptorPool = _descriptorPool;
 		allocInfo.descriptorSetCount = static_cast<uint32_t>(_swapChainImages.size());
 		allocInfo.pSetLayouts = layouts.data();
 
-		for (int j = 0; j < _meshes.size(); ++j)
+		_descriptorSets.resize(_swapChainImages.size());
+		if (vkAllocateDescriptorSets(_context.device, &allocInfo, _descriptorSets.data()) != VK_SUCCESS)
+			throw std::runtime_error("failed to allocate descriptor sets!");
+
+		VkDescriptorImageInfo placeholderInfo = {};
+		placeholderInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		placeholderInfo.imageView = _placeholderTexture.GetView();
+		placeholderInfo.sampler = _placeholderTexture.GetSampler();
+
+		for (uint32_t i = 0; i < _swapChainImages.size(); i++)
 		{
-			std::vector<VkDescriptorSet>& descriptorSets = _meshes[j]->GetDescriptorBuffer();
-			descriptorSets.resize(_swapChainImages.size());
-			if (vkAllocateDescriptorSets(_context.device, &allocInfo, descriptorSets.data()) != VK_SUCCESS)
-				throw std::runtime_error("failed to allocate descriptor sets!");
+			VkDescriptorBufferInfo frameInfo = { _frameUniformBuffers[i].GetBuffer(), 0, sizeof(FrameUniforms) };
 
-			for (size_t i = 0; i < _swapChainImages.size(); i++)
+			// Objects and materials are written by WriteObjectDescriptors
+			std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+			for (uint32_t j = 0; j < descriptorWrites.size(); ++j)
 			{
-				VkDescriptorBufferInfo bufferInfo = {};
-				bufferInfo.buffer = _meshes[j]->GetUniformBuffer()[i].GetBuffer();
-				bufferInfo.offset = 0;
-				bufferInfo.range = sizeof(UniformBufferObject);
-
-				VkDescriptorImageInfo imageInfo = {};
-				imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-				imageInfo.imageView = _meshes[j]->GetTextureView();
-				imageInfo.sampler = _meshes[j]->GetTextureSampler();
-
-				std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
-
-				descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-				descriptorWrites[0].dstSet = descriptorSets[i];
-				descriptorWrites[0].dstBinding = 0;
-				descriptorWrites[0].dstArrayElement = 0;
-				descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-				descriptorWrites[0].descriptorCount = 1;
-				descriptorWrites[0].pBufferInfo = &bufferInfo;
-
-				descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-				descriptorWrites[1].dstSet = descriptorSets[i];
-				descriptorWrites[1].dstBinding = 1;
-				descriptorWrites[1].dstArrayElement = 0;
-				descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-				descriptorWrites[1].descriptorCount = 1;
-				descriptorWrites[1].pImageInfo = &imageInfo;
-
-				vkUpdateDescriptorSets(_context.device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+				descriptorWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				descriptorWrites[j].dstSet = _descriptorSets[i];
+				descriptorWrites[j].dstArrayElement = 0;
+				descriptorWrites[j].descriptorCount = 1;
 			}
+
+			descriptorWrites[0].dstBinding = 0;
+			descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			descriptorWrites[0].pBufferInfo = &frameInfo;
+			descriptorWrites[1].dstBinding = 3;
+			descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			descriptorWrites[1].dstArrayElement = PLACEHOLDER_TEXTURE_SLOT;
+			descriptorWrites[1].pImageInfo = &placeholderInfo;
+
+			vkUpdateDescriptorSets(_context.device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+		}
+
+		std::vector<VkDescriptorSetLayout> cullLayouts(_swapChainImages.size(), _cullSetLayout);
+		allocInfo.pSetLayouts = cullLayouts.data();
+
+		_cullDescriptorSets.resize(_swapChainImages.size());
+		if (vkAllocateDescriptorSets(_context.device, &allocInfo, _cullDescriptorSets.data()) != VK_SUCCESS)
+			throw std::runtime_error("failed to allocate cull descriptor sets!");
+
+		WriteObjectDescriptors();
+
+		// New sets hold no texture yet, every texture a mesh references is written again
+		_staleTextureSlots.assign(_swapChainImages.size(), {});
+		_writtenTextureSlots.assign(_swapChainImages.size(), std::vector<bool>(MAX_BINDLESS_TEXTURES, false));
+
+		for (Mesh* mesh : _meshes)
+		{
+			for (uint32_t map = 0; map < MATERIAL_TEXTURE_COUNT; ++map)
+				MarkTextureStale(mesh->GetTexture(static_cast<MaterialTexture>(map)));
 		}
 	}
 
-	void Renderer::CreateCommandBuffers()
+	void Renderer::MarkTextureStale(TextureHandle texture)
 	{
-		_commandBuffers.resize(_swapChainFramebuffers.size());
+		if (!texture.IsValid() || texture.id + 1 >= MAX_BINDLESS_TEXTURES)
+			return;
 
-		VkCommandBufferAllocateInfo allocInfo = {};
-		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandBufferCount = (uint32_t)_commandBuffers.size();
+		const uint32_t slot = texture.id + 1;
+		for (std::vector<uint32_t>& stale : _staleTextureSlots)
+		{
+			if (std::find(stale.begin(), stale.end(), slot) == stale.end())
+				stale.push_back(slot);
+		}
+	}
 
-		_context.commandPool.AllocateCommandBuffer(_context.device, &allocInfo, _commandBuffers.data());
+	void Renderer::UpdateTextureSlots(uint32_t imageIndex)
+	{
+		std::vector<uint32_t>& stale = _staleTextureSlots[imageIndex];
+		if (stale.empty())
+			return;
 
-		if (vkAllocateCommandBuffers(_context.device, &allocInfo, _commandBuffers.data()) != VK_SUCCESS)
-			throw std::runtime_error("failed to allocate command buffers!");
+		// Sized up front, the writes point into it
+		std::vector<VkDescriptorImageInfo> imageInfos;
+		std::vector<VkWriteDescriptorSet> descriptorWrites;
+		imageInfos.reserve(stale.size());
+		descriptorWrites.reserve(stale.size());
 
-		for (size_t i = 0; i < _commandBuffers.size(); i++)
+		for (uint32_t slot : stale)
 		{
-			VkCommandBufferBeginInfo beginInfo = {};
-			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-			beginInfo.flags = 0; // Optional
-			beginInfo.pInheritanceInfo = nullptr; // Optional
+			TextureHandle texture;
+			texture.id = slot - 1;
+			if (!_textureManager.IsReady(texture))
+				continue;
+
+			const Texture& resident = _textureManager.GetTexture(texture);
+
+			VkDescriptorImageInfo imageInfo = {};
+			imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			imageInfo.imageView = resident.GetView();
+			imageInfo.sampler = resident.GetSampler();
+			imageInfos.push_back(imageInfo);
+
+			VkWriteDescriptorSet descriptorWrite = {};
+			descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrite.dstSet = _descriptorSets[imageIndex];
+			descriptorWrite.dstBinding = 3;
+			descriptorWrite.dstArrayElement = slot;
+			descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			descriptorWrite.descriptorCount = 1;
+			descriptorWrite.pImageInfo = &imageInfos.back();
+			descriptorWrites.push_back(descriptorWrite);
+
+			_writtenTextureSlots[imageIndex][slot] = true;
+		}
+		stale.clear();
 
-			if (vkBeginCommandBuffer(_commandBuffers[i], &beginInfo) != VK_SUCCESS)
-				throw std::runtime_error("failed to begin recording command buffer!");
+		vkUpdateDescriptorSets(_context.device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+	}
 
-			VkRenderPassBeginInfo renderPassInfo = {};
-			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			renderPassInfo.renderPass = _renderPass;
-			renderPassInfo.framebuffer = _swapChainFramebuffers[i];
-			renderPassInfo.renderArea.offset = { 0, 0 };
-			renderPassInfo.renderArea.extent = _swapChainExtent;
-			std::array<VkClearValue, 2> clearValues = {};
-			clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
-			clearValues[1].depthStencil = { 1.0f, 0 };
+	uint32_t Renderer::GetTextureSlot(TextureHandle texture, uint32_t imageIndex) const
+	{
+		if (!texture.IsValid() || texture.id + 1 >= MAX_BINDLESS_TEXTURES || !_writtenTextureSlots[imageIndex][texture.id + 1])
+			return MATERIAL_NO_TEXTURE;
 
-			renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-			renderPassInfo.pClearValues = clearValues.data();
+		return texture.id + 1;
+	}
+
+	void Renderer::CreatePlaceholderTexture()
+	{
+		const unsigned char white[4] = { 255, 255, 255, 255 };
+
+		_placeholderTexture.LoadPixels(white, 1, 1);
+		_placeholderTexture.CreateTexture(_context);
+		// Sampled from the first frame on
+		_context.staging->Flush();
+	}
+
+	void Renderer::RequestScene()
+	{
+		MeshLoadSettings settings;
+		settings.vertexFormat = VERTEX_FORMAT_PACKED;
 
-			vkCmdBeginRenderPass(_commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		MaterialFiles material;
+		material.textures[MATERIAL_TEXTURE_BASE_COLOR] = "Media/fantasy_game_inn_diffuse.png";
+		material.textures[MATERIAL_TEXTURE_EMISSIVE] = "Media/fantasy_game_inn_emissive.png";
 
-			vkCmdBindPipeline(_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, _graphicsPipeline);
+		_assetLoader.RequestMesh("Media/fantasy_game_inn.obj", material, settings);
+	}
+
+	void Renderer::AcceptLoadedAssets()
+	{
+		std::vector<Mesh*> meshes;
+		_assetLoader.TakeMeshes(meshes);
+
+		for (Mesh* mesh : meshes)
+		{
+			_meshes.push_back(mesh);
+
+			// Meshes never move, their world sphere is set once
+			const Bounds& bounds = mesh->GetBounds();
+			const glm::mat4 model = GetModelMatrix();
+			const float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+
+			_culler.Resize(_meshes.size());
+			_culler.Set(_meshes.size() - 1, glm::vec3(model * glm::vec4(bounds.GetCenter(), 1.0f)), bounds.GetRadius() * scale);
+		}
 
-			for (int j = 0; j < _meshes.size(); ++j)
+		// Every loaded mesh is kept, the per object buffers grow to fit
+		GrowObjectBuffers(_meshes.size());
+
+		// A set may be in use by a frame in flight, each image writes the new slots once its fence is done
+		std::vector<LoadedTexture> textures;
+		_assetLoader.TakeTextures(textures);
+
+		for (LoadedTexture& loaded : textures)
+		{
+			if (std::find(_meshes.begin(), _meshes.end(), loaded.mesh) == _meshes.end())
 			{
-				VkBuffer vertexBuffers[] = { _meshes[j]->GetVertexBuffer() };
-				VkDeviceSize offsets[] = { 0 };
-				vkCmdBindVertexBuffers(_commandBuffers[i], 0, 1, vertexBuffers, offsets);
+				_textureManager.Release(loaded.texture);
+				continue;
+			}
+
+			loaded.mesh->SetTexture(loaded.map, loaded.texture);
+			MarkTextureStale(loaded.texture);
+		}
+	}
 
-				vkCmdBindIndexBuffer(_commandBuffers[i], _meshes[j]->GetIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+	void Renderer::CreateFrameCommands()
+	{
+		QueueFamilyIndices queueFamilyIndices;
+		queueFamilyIndices.FindQueueFamilies(_context.physicalDevice, _context.surface);
+		const uint32_t graphicsFamily = queueFamilyIndices.graphicsFamily.value();
+
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandBufferCount = 1;
 
-				vkCmdBindDescriptorSets(_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 0, 1, &(_meshes[j]->GetDescriptorBuffer()[i]), 0, nullptr);
+		// As many recording tasks as the thread pool runs at once, the calling thread included
+		const size_t taskCount = ThreadPool::Get().GetThreadCount() + 1;
 
-				vkCmdDrawIndexed(_commandBuffers[i], _meshes[j]->GetIndexSize(), 1, 0, 0, 0);
+		// Buffers are never reset one by one, the whole pool is once the frame is done with it
+		_frameCommands.resize(MAX_FRAMES_IN_FLIGHT);
+		for (FrameCommands& frame : _frameCommands)
+		{
+			frame.pool.Create(_context.device, graphicsFamily, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			frame.pool.AllocateCommandBuffer(_context.device, &allocInfo, &frame.commandBuffer);
+
+			frame.recordPools.resize(taskCount);
+			frame.secondaryCommandBuffers.resize(taskCount);
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			for (size_t task = 0; task < taskCount; ++task)
+			{
+				frame.recordPools[task].Create(_context.device, graphicsFamily, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+				frame.recordPools[task].AllocateCommandBuffer(_context.device, &allocInfo, &frame.secondaryCommandBuffers[task]);
 			}
+		}
+	}
+
+	void Renderer::DestroyFrameCommands()
+	{
+		// Destroying a pool frees its buffers
+		for (FrameCommands& frame : _frameCommands)
+		{
+			for (CommandPool& pool : frame.recordPools)
+				pool.Destroy(_context.device);
+			frame.pool.Destroy(_context.device);
+		}
+		_frameCommands.clear();
+	}
+
+	void Renderer::BuildDrawList()
+	{
+		if (_context.cmdDrawIndexedIndirectCount == nullptr)
+		{
+			_culler.Cull(Frustum::FromMatrix(GetProjectionMatrix() * cam.GetInverseMatrix()), _drawList);
+			return;
+		}
+
+		_drawList.resize(_meshes.size());
+		for (size_t i = 0; i < _meshes.size(); ++i)
+			_drawList[i] = static_cast<uint32_t>(i);
+	}
+
+	void Renderer::RecordCommandBuffer(uint32_t imageIndex)
+	{
+		FrameCommands& frame = _frameCommands[_currentFrame];
+		VkCommandBuffer commandBuffer = frame.commandBuffer;
+
+		// The frame's fence signalled, nothing recorded into its pools is pending anymore
+		frame.pool.Reset(_context.device);
+		for (CommandPool& pool : frame.recordPools)
+			pool.Reset(_context.device);
+
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		beginInfo.pInheritanceInfo = nullptr; // Optional
+
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+			throw std::runtime_error("failed to begin recording command buffer!");
+
+		VkRenderPassBeginInfo renderPassInfo = {};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = _renderPass;
+		renderPassInfo.framebuffer = _swapChainFramebuffers[imageIndex];
+		renderPassInfo.renderArea.offset = { 0, 0 };
+		renderPassInfo.renderArea.extent = _swapChainExtent;
+		std::array<VkClearValue, 2> clearValues = {};
+		clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+		renderPassInfo.pClearValues = clearValues.data();
+
+		// The whole scene in a few indirect draws when the device can, the draws recorded one by one otherwise
+		if (_context.cmdDrawIndexedIndirectCount != nullptr)
+		{
+			RecordCulling(commandBuffer, imageIndex);
 
-			vkCmdEndRenderPass(_commandBuffers[i]);
+			vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+			RecordIndirectDraws(commandBuffer, imageIndex);
+			vkCmdEndRenderPass(commandBuffer);
 
-			if (vkEndCommandBuffer(_commandBuffers[i]) != VK_SUCCESS)
+			if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
 				throw std::runtime_error("failed to record command buffer!");
+			return;
+		}
+
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+		// Contiguous draw list ranges, executed in order so the result matches a single threaded recording
+		size_t taskCount = std::min((_drawList.size() + RECORD_DRAWS_PER_TASK - 1) / RECORD_DRAWS_PER_TASK, frame.recordPools.size());
+		size_t drawsPerTask = taskCount > 0 ? (_drawList.size() + taskCount - 1) / taskCount : 0;
+
+		ThreadPool::Get().ParallelFor(taskCount, [&](size_t task)
+		{
+			size_t first = task * drawsPerTask;
+			size_t last = std::min(first + drawsPerTask, _drawList.size());
+			RecordDraws(frame.secondaryCommandBuffers[task], imageIndex, first, last);
+		});
+
+		if (taskCount > 0)
+			vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(taskCount), frame.secondaryCommandBuffers.data());
+
+		vkCmdEndRenderPass(commandBuffer);
+
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+			throw std::runtime_error("failed to record command buffer!");
+	}
+
+	void Renderer::RecordDraws(VkCommandBuffer commandBuffer, uint32_t imageIndex, size_t firstDraw, size_t lastDraw)
+	{
+		VkCommandBufferInheritanceInfo inheritanceInfo = {};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = _renderPass;
+		inheritanceInfo.subpass = 0;
+		inheritanceInfo.framebuffer = _swapChainFramebuffers[imageIndex];
+
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+			throw std::runtime_error("failed to begin recording secondary command buffer!");
+
+		// Secondary buffers inherit no state. Every pipeline shares the layout, the set stays bound across pipeline changes
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 0, 1, &_descriptorSets[imageIndex], 0, nullptr);
+
+		// Every mesh lives in the geometry pool, draws only differ by their offsets into it
+		VkBuffer vertexBuffers[] = { _context.geometry->GetVertexBuffer() };
+		VkDeviceSize offsets[] = { 0 };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+
+		VkPipeline boundPipeline = VK_NULL_HANDLE;
+		VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+		for (size_t draw = firstDraw; draw < lastDraw; ++draw)
+		{
+			const uint32_t j = _drawList[draw];
+			VkPipeline pipeline = _graphicsPipelines[_meshes[j]->GetVertexFormat()];
+			if (pipeline != boundPipeline)
+			{
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+				boundPipeline = pipeline;
+			}
+
+			// Index ranges are aligned for both types, the same buffer is only rebound when the type changes
+			if (_meshes[j]->GetIndexType() != boundIndexType)
+			{
+				boundIndexType = _meshes[j]->GetIndexType();
+				vkCmdBindIndexBuffer(commandBuffer, _context.geometry->GetIndexBuffer(), 0, boundIndexType);
+			}
+
+			const MeshLod& lod = _meshes[j]->GetLod(j < _meshLods.size() ? _meshLods[j] : 0);
+			vkCmdDrawIndexed(commandBuffer, lod.indexCount, 1, _meshes[j]->GetFirstIndex() + lod.firstIndex, _meshes[j]->GetVertexOffset(), j);
+		}
+
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+			throw std::runtime_error("failed to record secondary command buffer!");
+	}
+
+	void Renderer::RecordIndirectDraws(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+	{
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 0, 1, &_descriptorSets[imageIndex], 0, nullptr);
+
+		VkBuffer vertexBuffers[] = { _context.geometry->GetVertexBuffer() };
+		VkDeviceSize offsets[] = { 0 };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+
+		// Every group is drawn, an empty one has a count of 0
+		const VkDeviceSize stride = sizeof(VkDrawIndexedIndirectCommand);
+		for (uint32_t group = 0; group < DRAW_GROUP_COUNT; ++group)
+		{
+			if (group % 2 == 0)
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _graphicsPipelines[group / 2]);
+			vkCmdBindIndexBuffer(commandBuffer, _context.geometry->GetIndexBuffer(), 0, group % 2 == 0 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32);
+
+			_context.cmdDrawIndexedIndirectCount(commandBuffer, _drawCommandBuffers[imageIndex].GetBuffer(), group * _objectCapacity * stride,
+				_drawCountBuffers[imageIndex].GetBuffer(), group * sizeof(uint32_t), _objectCapacity, static_cast<uint32_t>(stride));
+		}
+	}
+
+	void Renderer::RecordCulling(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+	{
+		VkBuffer commands = _drawCommandBuffers[imageIndex].GetBuffer();
+		VkBuffer counts = _drawCountBuffers[imageIndex].GetBuffer();
+
+		// The image's previous frame is done with both buffers, only the cleared counts need a barrier
+		vkCmdFillBuffer(commandBuffer, counts, 0, VK_WHOLE_SIZE, 0);
+		BarrierBatch().AddBuffer(counts, RESOURCE_STATE_TRANSFER_DST, RESOURCE_STATE_COMPUTE_SHADER_READ_WRITE).Flush(commandBuffer);
+
+		CullConstants constants = {};
+		const Frustum frustum = Frustum::FromMatrix(GetProjectionMatrix() * cam.GetInverseMatrix());
+		for (uint32_t i = 0; i < 6; ++i)
+			constants.planes[i] = frustum.planes[i];
+		constants.objectCount = static_cast<uint32_t>(_drawList.size());
+		constants.drawsPerGroup = _objectCapacity;
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipelineLayout, 0, 1, &_cullDescriptorSets[imageIndex], 0, nullptr);
+		vkCmdPushConstants(commandBuffer, _cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+		vkCmdDispatch(commandBuffer, (constants.objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+		BarrierBatch()
+			.AddBuffer(commands, RESOURCE_STATE_COMPUTE_SHADER_READ_WRITE, RESOURCE_STATE_INDIRECT_ARGUMENT)
+			.AddBuffer(counts, RESOURCE_STATE_COMPUTE_SHADER_READ_WRITE, RESOURCE_STATE_INDIRECT_ARGUMENT)
+			.Flush(commandBuffer);
+	}
+
+	void Renderer::WriteCullObjects(uint32_t imageIndex)
+	{
+		CullObject* cullObjects = _cullObjectBuffers[imageIndex].GetMappedData<CullObject>();
+
+		for (size_t i = 0; i < _drawList.size(); ++i)
+		{
+			const uint32_t j = _drawList[i];
+			const Mesh& mesh = *_meshes[j];
+			const MeshLod& lod = mesh.GetLod(j < _meshLods.size() ? _meshLods[j] : 0);
+			const Bounds& bounds = mesh.GetBounds();
+
+			// Built on the stack and stored whole, the mapping may be write combined
+			CullObject object = {};
+			object.sphere = glm::vec4(bounds.GetCenter(), bounds.GetRadius());
+			object.indexCount = lod.indexCount;
+			object.firstIndex = mesh.GetFirstIndex() + lod.firstIndex;
+			object.vertexOffset = mesh.GetVertexOffset();
+			object.objectIndex = j;
+			object.group = GetDrawGroup(mesh);
+			cullObjects[i] = object;
+		}
+
+		_cullObjectBuffers[imageIndex].Flush(0, sizeof(CullObject) * _drawList.size());
+	}
+
+	glm::mat4 Renderer::GetProjectionMatrix() const
+	{
+		glm::mat4 proj = glm::perspective(glm::radians(FIELD_OF_VIEW), _swapChainExtent.width / (float)_swapChainExtent.height, NEAR_PLANE, FAR_PLANE);
+		proj[1][1] *= -1;
+
+		return proj;
+	}
+
+	glm::mat4 Renderer::GetModelMatrix() const
+	{
+		return glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -1.0f, 0.0f));
+	}
+
+	void Renderer::SelectLods()
+	{
+		_meshLods.resize(_meshes.size(), 0);
+
+		// World units to pixels at distance 1, the LOD errors are divided by the distance to the bounds
+		const float pixelsPerUnit = _swapChainExtent.height / (2.0f * std::tan(glm::radians(FIELD_OF_VIEW) * 0.5f));
+
+		for (size_t i = 0; i < _meshes.size(); ++i)
+		{
+			const Mesh& mesh = *_meshes[i];
+			const Bounds& bounds = mesh.GetBounds();
+
+			glm::vec3 center = glm::vec3(GetModelMatrix() * glm::vec4(bounds.GetCenter(), 1.0f));
+			float distance = std::max(glm::length(cam.position - center) - bounds.GetRadius(), NEAR_PLANE);
+			float scale = pixelsPerUnit / distance;
+
+			// Go coarser only once the next LOD is comfortably under the threshold, finer as soon as
+			// the current one is over it, so an object near a switch distance does not flicker
+			uint32_t lod = _meshLods[i];
+			while (lod + 1 < mesh.GetLodCount() && mesh.GetLod(lod + 1).error * scale <= LOD_PIXEL_ERROR * (1.0f - LOD_HYSTERESIS))
+				lod++;
+			while (lod > 0 && mesh.GetLod(lod).error * scale > LOD_PIXEL_ERROR)
+				lod--;
+
+			_meshLods[i] = lod;
+		}
+	}
+
+	void Renderer::StreamTextures()
+	{
+		const float pixelsPerUnit = _swapChainExtent.height / (2.0f * std::tan(glm::radians(FIELD_OF_VIEW) * 0.5f));
+
+		// Texture resolution wanted from the on-screen diameter of the mesh, assuming its UVs cover the texture once
+		for (size_t i = 0; i < _meshes.size(); ++i)
+		{
+			const Bounds& bounds = _meshes[i]->GetBounds();
+
+			glm::vec3 center = glm::vec3(GetModelMatrix() * glm::vec4(bounds.GetCenter(), 1.0f));
+			float distance = std::max(glm::length(cam.position - center) - bounds.GetRadius(), NEAR_PLANE);
+
+			for (uint32_t map = 0; map < MATERIAL_TEXTURE_COUNT; ++map)
+				_textureManager.RequestResolution(_meshes[i]->GetTexture(static_cast<MaterialTexture>(map)), 2.0f * bounds.GetRadius() * pixelsPerUnit / distance);
 		}
+
+		// A replaced image is still in the other images' texture arrays until each of them is acquired
+		// again and its slot rewritten, then frames in flight may still read it
+		std::vector<TextureHandle> changed;
+		const uint64_t retireFrame = _frameCount + _swapChainImages.size() + MAX_FRAMES_IN_FLIGHT;
+		_context.staging->Reclaim();
+		_context.staging->BeginFrame();
+		_textureManager.UpdateStreaming(_context, _frameCount, retireFrame, changed);
+		_textureManager.CollectGarbage(_context.device, _frameCount);
+
+		// Never waited on, the new images are swapped in by a later UpdateStreaming once their batch completed
+		_context.staging->Submit();
+
+		for (TextureHandle texture : changed)
+			MarkTextureStale(texture);
 	}
 
 	void Renderer::CreateSyncObjects()
@@ -680,10 +1292,12 @@ namespace Application
 			glfwPollEvents();
 			if (shaderChanged)
 				RecreateGraphicPipeline();
+			AcceptLoadedAssets();
 			DrawFrame();
 			_inputManager.Update(_window, this);
 		}
 
+		std::lock_guard<std::mutex> lock(*_context.queueMutex);
 		vkDeviceWaitIdle(_context.device);
 	}
 
@@ -709,6 +1323,14 @@ namespace Application
 		// Mark the image as now being in use by this frame
 		_imagesInFlight[imageIndex] = _inFlightFences[_currentFrame];
 
+		SelectLods();
+		StreamTextures();
+		UpdateTextureSlots(imageIndex);
+		BuildDrawList();
+		if (_context.cmdDrawIndexedIndirectCount != nullptr)
+			WriteCullObjects(imageIndex);
+		RecordCommandBuffer(imageIndex);
+
 		UpdateUniformBuffer(imageIndex);
 
 		VkSubmitInfo submitInfo = {};
@@ -721,12 +1343,13 @@ namespace Application
 		submitInfo.pWaitSemaphores = waitSemaphores;
 		submitInfo.pWaitDstStageMask = waitStages;
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &_commandBuffers[imageIndex];
+		submitInfo.pCommandBuffers = &_frameCommands[_currentFrame].commandBuffer;
 		submitInfo.signalSemaphoreCount = 1;
 		submitInfo.pSignalSemaphores = signalSemaphores;
 
 		vkResetFences(_context.device, 1, &_inFlightFences[_currentFrame]);
 
+		std::unique_lock<std::mutex> queueLock(*_context.queueMutex);
 		if (vkQueueSubmit(_context.graphicsQueue, 1, &submitInfo, _inFlightFences[_currentFrame]) != VK_SUCCESS)
 			throw std::runtime_error("failed to submit draw command buffer!");
 
@@ -742,6 +1365,7 @@ namespace Application
 		presentInfo.pResults = nullptr; // Optional
 
 		result = vkQueuePresentKHR(_context.presentQueue, &presentInfo);
+		queueLock.unlock();
 
 		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized)
 		{
@@ -752,6 +1376,7 @@ namespace Application
 			throw std::runtime_error("failed to present swap chain image!");
 
 		_currentFrame = (_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+		_frameCount++;
 	}
 
 	void Renderer::UpdateUniformBuffer(uint32_t currentImage)
@@ -761,29 +1386,69 @@ namespace Application
 		auto currentTime = std::chrono::high_resolution_clock::now();
 		float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
 
-		UniformBufferObject ubo = {};
-		ubo.model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -1.0f, 0.0f));
-		ubo.view = cam.GetInverseMatrix();
-		ubo.proj = glm::perspective(glm::radians(45.0f), _swapChainExtent.width / (float)_swapChainExtent.height, 0.1f, 100.0f);
-		ubo.proj[1][1] *= -1;
+		FrameUniforms frame = {};
+		frame.view = cam.GetInverseMatrix();
+		frame.proj = GetProjectionMatrix();
+
+		// Written in place, the buffers stay mapped and the image's previous frame is done with them.
+		// The mapping may be write combined: built on the stack and stored whole, never read back.
+		*_frameUniformBuffers[currentImage].GetMappedData<FrameUniforms>() = frame;
+		_frameUniformBuffers[currentImage].Flush(0, sizeof(FrameUniforms));
+
+		if (_meshes.empty())
+			return;
 
-		_meshes[0]->GetUniformBuffer()[currentImage].MapMemory(_context.device, 0, sizeof(ubo), 0, &ubo);
+		ObjectData* objects = _objectBuffers[currentImage].GetMappedData<ObjectData>();
+		MaterialData* materials = _materialBuffers[currentImage].GetMappedData<MaterialData>();
+		for (size_t i = 0; i < _meshes.size(); ++i)
+		{
+			ObjectData object;
+			object.model = GetModelMatrix();
+			object.positionScale = glm::vec4(_meshes[i]->GetPositionScale(), 0.0f);
+			object.positionOffset = glm::vec4(_meshes[i]->GetPositionOffset(), 0.0f);
+			objects[i] = object;
+
+			// Slots are resolved per image, a texture not written in this image's set yet is not sampled
+			MaterialData material = {};
+			for (uint32_t map = 0; map < MATERIAL_TEXTURE_COUNT; ++map)
+				material.textures[map] = GetTextureSlot(_meshes[i]->GetTexture(static_cast<MaterialTexture>(map)), currentImage);
+
+			// Meshes are drawn with the placeholder until the loader hands over their texture
+			if (material.textures[MATERIAL_TEXTURE_BASE_COLOR] == MATERIAL_NO_TEXTURE)
+				material.textures[MATERIAL_TEXTURE_BASE_COLOR] = PLACEHOLDER_TEXTURE_SLOT;
+			materials[i] = material;
+		}
+
+		_objectBuffers[currentImage].Flush(0, sizeof(ObjectData) * _meshes.size());
+		_materialBuffers[currentImage].Flush(0, sizeof(MaterialData) * _meshes.size());
 	}
 
 	void Renderer::Cleanup()
 	{
+		_assetLoader.Destroy(_context.device);
+
 		CleanupSwapChain();
 
+		DestroyFrameCommands();
+		DestroyCullPipeline();
+
+		_placeholderTexture.Destroy(_context.device);
+
 		for (size_t i = 0; i < _shaders.size(); ++i)
 			_shaders[i].Destroy(_context.device);
 
 		for (int i = 0; i < _meshes.size(); ++i)
 		{
+			for (uint32_t map = 0; map < MATERIAL_TEXTURE_COUNT; ++map)
+				_textureManager.Release(_meshes[i]->GetTexture(static_cast<MaterialTexture>(map)));
 			_meshes[i]->Destroy(_context.device);
 			delete _meshes[i];
 		}
 
+		_textureManager.Destroy(_context.device);
+
 		vkDestroyDescriptorSetLayout(_context.device, _descriptorSetLayout, nullptr);
+		vkDestroyDescriptorSetLayout(_context.device, _cullSetLayout, nullptr);
 
 		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 		{
@@ -803,16 +1468,16 @@ namespace Application
 	{
 		vkDestroyImageView(_context.device, _depthImageView, nullptr);
 		vkDestroyImage(_context.device, _depthImage, nullptr);
-		vkFreeMemory(_context.device, _depthImageMemory, nullptr);
+		_context.allocator->Free(_depthImageMemory);
 
 		for (size_t i = 0; i < _swapChainFramebuffers.size(); i++)
 		{
 			vkDestroyFramebuffer(_context.device, _swapChainFramebuffers[i], nullptr);
 		}
 
-		_context.commandPool.FreeCommandBuffer(_context.device, static_cast<uint32_t>(_commandBuffers.size()), _commandBuffers.data());
 
-		vkDestroyPipeline(_context.device, _graphicsPipeline, nullptr);
+		for (size_t i = 0; i < _graphicsPipelines.size(); ++i)
+			vkDestroyPipeline(_context.device, _graphicsPipelines[i], nullptr);
 		vkDestroyPipelineLayout(_context.device, _pipelineLayout, nullptr);
 		vkDestroyRenderPass(_context.device, _renderPass, nullptr);
 
@@ -823,13 +1488,12 @@ namespace Application
 
 		vkDestroySwapchainKHR(_context.device, _swapChain, nullptr);
 
-		for (size_t i = 0; i < _meshes.size(); ++i)
+		for (size_t i = 0; i < _frameUniformBuffers.size(); ++i)
 		{
-			for (size_t j = 0; j < _swapChainImages.size(); ++j)
-			{
-				_meshes[i]->GetUniformBuffer()[j].Destroy(_context.device);
-			}
+			_frameUniformBuffers[i].Destroy(_context.device);
+			_drawCountBuffers[i].Destroy(_context.device);
 		}
+		DestroyObjectBuffers();
 
 		vkDestroyDescriptorPool(_context.device, _descriptorPool, nullptr);
 	}
@@ -844,7 +1508,14 @@ namespace Application
 			glfwWaitEvents();
 		}
 
-		vkDeviceWaitIdle(_context.device);
+		{
+			std::lock_guard<std::mutex> lock(*_context.queueMutex);
+			vkDeviceWaitIdle(_context.device);
+		}
+
+		// Nothing is in flight once the streaming uploads are done, a safe point to drop textures no mesh references anymore
+		_context.staging->Flush();
+		_textureManager.DestroyUnused(_context.device);
 
 		CleanupSwapChain();
 
@@ -857,35 +1528,24 @@ namespace Application
 		CreateUniformBuffers();
 		CreateDescriptorPool();
 		CreateDescriptorSets();
-		CreateCommandBuffers();
 	}
 
 	void Renderer::RecreateGraphicPipeline()
 	{
-		vkDeviceWaitIdle(_context.device);
-
-		vkDestroyPipeline(_context.device, _graphicsPipeline, nullptr);
-		vkDestroyPipelineLayout(_context.device, _pipelineLayout, nullptr);
-		_context.commandPool.FreeCommandBuffer(_context.device, static_cast<uint32_t>(_commandBuffers.size()), _commandBuffers.data());
-
-		for (int i = 0; i < _meshes.size(); ++i)
 		{
-			for (size_t j = 0; j < _swapChainImages.size(); ++j)
-			{
-				_meshes[i]->GetUniformBuffer()[j].Destroy(_context.device);
-			}
-			_meshes[i]->Destroy(_context.device);
-			delete _meshes[i];
+			std::lock_guard<std::mutex> lock(*_context.queueMutex);
+			vkDeviceWaitIdle(_context.device);
 		}
-		_meshes.resize(0);
 
-		vkDestroyDescriptorPool(_context.device, _descriptorPool, nullptr);
-		
+		// Meshes stay resident, only the pipelines are rebuilt, the next frame records with the new ones
+		for (size_t i = 0; i < _graphicsPipelines.size(); ++i)
+			vkDestroyPipeline(_context.device, _graphicsPipelines[i], nullptr);
+		vkDestroyPipelineLayout(_context.device, _pipelineLayout, nullptr);
+
 		CreateGraphicsPipeline();
-		CreateUniformBuffers();
-		CreateDescriptorPool();
-		CreateDescriptorSets();
-		CreateCommandBuffers();
+
+		DestroyCullPipeline();
+		CreateCullPipeline();
 
 		shaderChanged = false;
 	}
@@ -0,0 +1,168 @@
+#include "SphereCuller.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cfloat>
+
+#if defined(__AVX2__)
+#define SPHERE_CULLER_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SPHERE_CULLER_SSE2
+#include <emmintrin.h>
+#endif
+
+// Arrays are padded to this so the SIMD loops have no tail
+#define SPHERE_CULLER_PADDING 8
+
+void SphereCuller::Resize(size_t count)
+{
+	// Removed spheres become padding, old padding becomes new spheres that stay culled until set
+	for (size_t i = count; i < _count; ++i)
+	{
+		_centerX[i] = _centerY[i] = _centerZ[i] = 0.0f;
+		_radius[i] = -FLT_MAX;
+	}
+
+	const size_t padded = (count + SPHERE_CULLER_PADDING - 1) / SPHERE_CULLER_PADDING * SPHERE_CULLER_PADDING;
+	_centerX.resize(padded, 0.0f);
+	_centerY.resize(padded, 0.0f);
+	_centerZ.resize(padded, 0.0f);
+	_radius.resize(padded, -FLT_MAX);
+
+	_count = count;
+}
+
+void SphereCuller::Set(size_t index, const glm::vec3& center, float radius)
+{
+	_centerX[index] = center.x;
+	_centerY[index] = center.y;
+	_centerZ[index] = center.z;
+	_radius[index] = radius;
+}
+
+void SphereCuller::Cull(const Frustum& frustum, std::vector<uint32_t>& visible)
+{
+	visible.clear();
+
+	const size_t padded = _radius.size();
+	const size_t taskCount = (padded + CULL_SPHERES_PER_TASK - 1) / CULL_SPHERES_PER_TASK;
+
+	if (taskCount <= 1)
+	{
+		visible.resize(padded);
+		visible.resize(CullRange(frustum, 0, padded, visible.data()));
+		return;
+	}
+
+	if (_taskVisible.size() < taskCount)
+		_taskVisible.resize(taskCount);
+
+	ThreadPool::Get().ParallelFor(taskCount, [&](size_t task)
+	{
+		const size_t first = task * CULL_SPHERES_PER_TASK;
+		const size_t last = std::min(first + CULL_SPHERES_PER_TASK, padded);
+
+		std::vector<uint32_t>& taskVisible = _taskVisible[task];
+		taskVisible.resize(last - first);
+		taskVisible.resize(CullRange(frustum, first, last, taskVisible.data()));
+	});
+
+	// Tasks are in index order, so is their concatenation
+	for (size_t task = 0; task < taskCount; ++task)
+		visible.insert(visible.end(), _taskVisible[task].begin(), _taskVisible[task].end());
+}
+
+size_t SphereCuller::CullRange(const Frustum& frustum, size_t first, size_t last, uint32_t* visible) const
+{
+	size_t visibleCount = 0;
+	size_t i = first;
+
+	// Blocks with nothing visible are skipped, in the others every index is written and the count only
+	// advances past visible ones, no branch per sphere
+#if defined(SPHERE_CULLER_AVX2)
+	__m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (uint32_t p = 0; p < 6; ++p)
+	{
+		planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+		planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+		planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+		planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+	}
+
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+
+	for (; i + 8 <= last; i += 8)
+	{
+		const __m256 x = _mm256_loadu_ps(&_centerX[i]);
+		const __m256 y = _mm256_loadu_ps(&_centerY[i]);
+		const __m256 z = _mm256_loadu_ps(&_centerZ[i]);
+		const __m256 negRadius = _mm256_xor_ps(_mm256_loadu_ps(&_radius[i]), signBit);
+
+		__m256 outside = _mm256_setzero_ps();
+		for (uint32_t p = 0; p < 6; ++p)
+		{
+			__m256 distance = _mm256_add_ps(_mm256_mul_ps(planeX[p], x), planeW[p]);
+			distance = _mm256_add_ps(_mm256_mul_ps(planeY[p], y), distance);
+			distance = _mm256_add_ps(_mm256_mul_ps(planeZ[p], z), distance);
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, negRadius, _CMP_LT_OQ));
+		}
+
+		const uint32_t inside = ~static_cast<uint32_t>(_mm256_movemask_ps(outside)) & 0xFF;
+		if (inside == 0)
+			continue;
+
+		for (uint32_t k = 0; k < 8; ++k)
+		{
+			visible[visibleCount] = static_cast<uint32_t>(i + k);
+			visibleCount += (inside >> k) & 1;
+		}
+	}
+#elif defined(SPHERE_CULLER_SSE2)
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (uint32_t p = 0; p < 6; ++p)
+	{
+		planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+		planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+		planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+		planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+	}
+
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+
+	for (; i + 4 <= last; i += 4)
+	{
+		const __m128 x = _mm_loadu_ps(&_centerX[i]);
+		const __m128 y = _mm_loadu_ps(&_centerY[i]);
+		const __m128 z = _mm_loadu_ps(&_centerZ[i]);
+		const __m128 negRadius = _mm_xor_ps(_mm_loadu_ps(&_radius[i]), signBit);
+
+		__m128 outside = _mm_setzero_ps();
+		for (uint32_t p = 0; p < 6; ++p)
+		{
+			__m128 distance = _mm_add_ps(_mm_mul_ps(planeX[p], x), planeW[p]);
+			distance = _mm_add_ps(_mm_mul_ps(planeY[p], y), distance);
+			distance = _mm_add_ps(_mm_mul_ps(planeZ[p], z), distance);
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negRadius));
+		}
+
+		const uint32_t inside = ~static_cast<uint32_t>(_mm_movemask_ps(outside)) & 0xF;
+		if (inside == 0)
+			continue;
+
+		for (uint32_t k = 0; k < 4; ++k)
+		{
+			visible[visibleCount] = static_cast<uint32_t>(i + k);
+			visibleCount += (inside >> k) & 1;
+		}
+	}
+#endif
+
+	for (; i < last; ++i)
+	{
+		visible[visibleCount] = static_cast<uint32_t>(i);
+		visibleCount += frustum.IntersectsSphere(glm::vec3(_centerX[i], _centerY[i], _centerZ[i]), _radius[i]) ? 1 : 0;
+	}
+
+	return visibleCount;
+}
@@ -0,0 +1,451 @@
+#include "StagingRing.h"
+#include "QueueFamilyIndices.h"
+
+#include <cstring>
+#include <stdexcept>
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+void StagingRing::Create(Context context, VkDeviceSize size)
+{
+	QueueFamilyIndices queueFamilyIndices;
+	queueFamilyIndices.FindQueueFamilies(context.physicalDevice, context.surface);
+
+	_device = context.device;
+	_graphicsQueue = context.graphicsQueue;
+	_transferQueue = context.transferQueue;
+	_graphicsFamily = queueFamilyIndices.graphicsFamily.value();
+	_transferFamily = queueFamilyIndices.transferFamily.value_or(_graphicsFamily);
+	_ownershipTransfer = _transferFamily != _graphicsFamily;
+	_queueMutex = context.queueMutex;
+	_allocator = context.allocator;
+	_size = size;
+	_head = 0;
+	_tail = 0;
+
+	const VkCommandPoolCreateFlags poolFlags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	_graphicsPool.Create(_device, _graphicsFamily, poolFlags);
+	if (_ownershipTransfer)
+	{
+		_transferPool.Create(_device, _transferFamily, poolFlags);
+		_releaseBarriers = BarrierBatch(BARRIER_OWNERSHIP_RELEASE, _transferFamily, _graphicsFamily);
+		_acquireBarriers = BarrierBatch(BARRIER_OWNERSHIP_ACQUIRE, _transferFamily, _graphicsFamily);
+	}
+
+	_buffer.CreateMappedBuffer(context, _size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+	_data = _buffer.GetMappedData<unsigned char>();
+}
+
+void StagingRing::Destroy()
+{
+	Flush();
+
+	for (Batch& batch : _freeBatches)
+		DestroyBatch(batch);
+	_freeBatches.clear();
+
+	_graphicsPool.Destroy(_device);
+	if (_ownershipTransfer)
+		_transferPool.Destroy(_device);
+
+	_buffer.Destroy(_device);
+	_data = nullptr;
+}
+
+void StagingRing::CopyToBuffer(const void* data, VkDeviceSize size, VkBuffer dst, VkDeviceSize dstOffset)
+{
+	BufferCopy copy;
+	copy.region.srcOffset = Stage(data, size, copy.source);
+	copy.region.dstOffset = dstOffset;
+	copy.region.size = size;
+	copy.dst = dst;
+
+	if (!_isRecording)
+		BeginBatch();
+	_bufferCopies.push_back(copy);
+
+	if (!_ownershipTransfer)
+		return;
+
+	_releaseBarriers.AddBuffer(dst, RESOURCE_STATE_TRANSFER_DST, RESOURCE_STATE_ANY_READ, dstOffset, size);
+	_acquireBarriers.AddBuffer(dst, RESOURCE_STATE_TRANSFER_DST, RESOURCE_STATE_ANY_READ, dstOffset, size);
+}
+
+void StagingRing::CopyToImage(const void* data, VkDeviceSize size, VkImage image, uint32_t mipLevels, const std::vector<MipLevel>& levels)
+{
+	ImageCopy copy;
+	VkDeviceSize offset = Stage(data, size, copy.source);
+	copy.image = image;
+	copy.firstRegion = static_cast<uint32_t>(_imageRegions.size());
+	copy.regionCount = static_cast<uint32_t>(levels.size());
+
+	if (!_isRecording)
+		BeginBatch();
+
+	for (size_t i = 0; i < levels.size(); ++i)
+	{
+		VkBufferImageCopy region = {};
+		region.bufferOffset = offset + levels[i].offset;
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = static_cast<uint32_t>(i);
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = { levels[i].width, levels[i].height, 1 };
+
+		_imageRegions.push_back(region);
+	}
+	_imageCopies.push_back(copy);
+
+	VkImageSubresourceRange range = {};
+	range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	range.baseMipLevel = 0;
+	range.levelCount = mipLevels;
+	range.baseArrayLayer = 0;
+	range.layerCount = 1;
+
+	_copyBarriers.AddImage(image, range, RESOURCE_STATE_UNDEFINED, RESOURCE_STATE_TRANSFER_DST);
+}
+
+void StagingRing::FinishImage(VkImage image, uint32_t mipLevels, ResourceState state)
+{
+	if (state != RESOURCE_STATE_FRAGMENT_SHADER_READ && state != RESOURCE_STATE_TRANSFER_DST)
+		throw std::invalid_argument("unsupported staging image state!");
+
+	if (!_isRecording)
+		BeginBatch();
+
+	VkImageSubresourceRange range = {};
+	range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	range.baseMipLevel = 0;
+	range.levelCount = mipLevels;
+	range.baseArrayLayer = 0;
+	range.layerCount = 1;
+
+	// The layout changes once, between the release and the acquire, both name the same transition
+	_releaseBarriers.AddImage(image, range, RESOURCE_STATE_TRANSFER_DST, state);
+	if (_ownershipTransfer)
+		_acquireBarriers.AddImage(image, range, RESOURCE_STATE_TRANSFER_DST, state);
+}
+
+VkCommandBuffer StagingRing::GetTransferCommandBuffer()
+{
+	if (!_isRecording)
+		BeginBatch();
+
+	RecordCopies();
+	return _recording.transferCommands;
+}
+
+VkCommandBuffer StagingRing::GetGraphicsCommandBuffer()
+{
+	if (!_isRecording)
+		BeginBatch();
+
+	RecordCopies();
+	return _recording.graphicsCommands;
+}
+
+void StagingRing::RecordCopies()
+{
+	// One barrier before every copy and one after, however many images the batch writes
+	_copyBarriers.Flush(_recording.transferCommands);
+
+	for (const BufferCopy& copy : _bufferCopies)
+		vkCmdCopyBuffer(_recording.transferCommands, copy.source, copy.dst, 1, &copy.region);
+	for (const ImageCopy& copy : _imageCopies)
+		vkCmdCopyBufferToImage(_recording.transferCommands, copy.source, copy.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			copy.regionCount, _imageRegions.data() + copy.firstRegion);
+
+	_bufferCopies.clear();
+	_imageCopies.clear();
+	_imageRegions.clear();
+
+	_releaseBarriers.Flush(_recording.transferCommands);
+	_acquireBarriers.Flush(_recording.graphicsCommands);
+}
+
+StagingRing::Batch StagingRing::CreateBatch()
+{
+	Batch batch;
+
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = 1;
+
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	try
+	{
+		_graphicsPool.AllocateCommandBuffer(_device, &allocInfo, &batch.graphicsCommands);
+		batch.transferCommands = batch.graphicsCommands;
+
+		if (vkCreateFence(_device, &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS)
+			throw std::runtime_error("failed to create staging fence!");
+
+		if (_ownershipTransfer)
+		{
+			batch.transferCommands = VK_NULL_HANDLE;
+			_transferPool.AllocateCommandBuffer(_device, &allocInfo, &batch.transferCommands);
+
+			if (vkCreateFence(_device, &fenceInfo, nullptr, &batch.transferFence) != VK_SUCCESS ||
+				vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &batch.semaphore) != VK_SUCCESS)
+				throw std::runtime_error("failed to create staging synchronization objects!");
+		}
+	}
+	catch (...)
+	{
+		DestroyBatch(batch);
+		throw;
+	}
+
+	return batch;
+}
+
+void StagingRing::DestroyBatch(Batch& batch)
+{
+	if (batch.graphicsCommands != VK_NULL_HANDLE)
+		_graphicsPool.FreeCommandBuffer(_device, 1, &batch.graphicsCommands);
+	if (_ownershipTransfer && batch.transferCommands != VK_NULL_HANDLE)
+		_transferPool.FreeCommandBuffer(_device, 1, &batch.transferCommands);
+
+	vkDestroyFence(_device, batch.fence, nullptr);
+	vkDestroyFence(_device, batch.transferFence, nullptr);
+	vkDestroySemaphore(_device, batch.semaphore, nullptr);
+	batch = Batch();
+}
+
+void StagingRing::BeginBatch()
+{
+	if (_freeBatches.empty())
+		_freeBatches.push_back(CreateBatch());
+
+	_recording = _freeBatches.back();
+	_freeBatches.pop_back();
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	if (vkBeginCommandBuffer(_recording.graphicsCommands, &beginInfo) != VK_SUCCESS ||
+		(_ownershipTransfer && vkBeginCommandBuffer(_recording.transferCommands, &beginInfo) != VK_SUCCESS))
+	{
+		vkResetCommandBuffer(_recording.graphicsCommands, 0);
+		_freeBatches.push_back(_recording);
+		throw std::runtime_error("failed to begin staging command buffer!");
+	}
+
+	_recording.id = _nextBatch++;
+	_recording.graphicsSubmitted = false;
+	_isRecording = true;
+}
+
+uint64_t StagingRing::Submit()
+{
+	if (!_isRecording)
+		return _submittedBatch;
+
+	RecordCopies();
+
+	// Whatever is submitted after this batch reads what it wrote, whichever stage it reads from
+	BarrierBatch().AddMemory(RESOURCE_STATE_TRANSFER_DST, RESOURCE_STATE_ANY_READ).Flush(_recording.graphicsCommands);
+
+	if (vkEndCommandBuffer(_recording.graphicsCommands) != VK_SUCCESS ||
+		(_ownershipTransfer && vkEndCommandBuffer(_recording.transferCommands) != VK_SUCCESS))
+		throw std::runtime_error("failed to record staging command buffer!");
+
+	if (_ownershipTransfer)
+	{
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &_recording.transferCommands;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &_recording.semaphore;
+
+		VkResult result;
+		{
+			std::lock_guard<std::mutex> lock(*_queueMutex);
+			result = vkQueueSubmit(_transferQueue, 1, &submitInfo, _recording.transferFence);
+		}
+		if (result != VK_SUCCESS)
+			throw std::runtime_error("failed to submit staging command buffer!");
+	}
+	else
+		SubmitGraphics(_recording);
+
+	_recording.end = _head;
+	_submittedBatch = _recording.id;
+	_pending.push_back(std::move(_recording));
+	_recording = Batch();
+	_isRecording = false;
+
+	return _submittedBatch;
+}
+
+void StagingRing::SubmitGraphics(Batch& batch)
+{
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.graphicsCommands;
+
+	// Already signaled when the copies went through their own queue, only the handoff is left
+	const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	if (_ownershipTransfer)
+	{
+		submitInfo.waitSemaphoreCount = 1;
+		submitInfo.pWaitSemaphores = &batch.semaphore;
+		submitInfo.pWaitDstStageMask = &waitStage;
+	}
+
+	VkResult result;
+	{
+		std::lock_guard<std::mutex> lock(*_queueMutex);
+		result = vkQueueSubmit(_graphicsQueue, 1, &submitInfo, batch.fence);
+	}
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("failed to submit staging command buffer!");
+
+	batch.graphicsSubmitted = true;
+}
+
+void StagingRing::Wait(uint64_t batch)
+{
+	while (!_pending.empty() && _pending.front().id <= batch)
+		WaitOldest();
+}
+
+void StagingRing::Flush()
+{
+	Wait(Submit());
+}
+
+void StagingRing::Reclaim()
+{
+	// In submission order, a later batch's handoff never overtakes an earlier one
+	for (Batch& batch : _pending)
+	{
+		if (batch.graphicsSubmitted)
+			continue;
+		if (vkGetFenceStatus(_device, batch.transferFence) != VK_SUCCESS)
+			break;
+
+		SubmitGraphics(batch);
+	}
+
+	while (!_pending.empty() && _pending.front().graphicsSubmitted && vkGetFenceStatus(_device, _pending.front().fence) == VK_SUCCESS)
+	{
+		Retire(_pending.front());
+		_pending.pop_front();
+	}
+}
+
+VkDeviceSize StagingRing::Stage(const void* data, VkDeviceSize size, VkBuffer& buffer)
+{
+	_frameBytes += size;
+
+	if (size > _size)
+	{
+		Context context;
+		context.device = _device;
+		context.allocator = _allocator;
+
+		Buffer overflow;
+		overflow.CreateMappedBuffer(context, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+		memcpy(overflow.GetMappedData<void>(), data, static_cast<size_t>(size));
+		overflow.Flush();
+
+		try
+		{
+			if (!_isRecording)
+				BeginBatch();
+		}
+		catch (...)
+		{
+			overflow.Destroy(_device);
+			throw;
+		}
+
+		_recording.overflow.push_back(overflow);
+		buffer = overflow.GetBuffer();
+		return 0;
+	}
+
+	Reclaim();
+
+	VkDeviceSize position;
+	while (true)
+	{
+		// An idle ring starts over at its beginning, a range never wraps around the end
+		if (_pending.empty() && !_isRecording)
+			_tail = _head;
+		if (_tail == _head)
+			_tail = _head = AlignUp(_head, _size);
+
+		position = AlignUp(_head, STAGING_ALIGNMENT);
+		if (position % _size + size > _size)
+			position = AlignUp(position, _size);
+
+		if (position + size <= _tail + _size)
+			break;
+
+		// Full, the batch being recorded holds the space when nothing is in flight
+		if (_pending.empty())
+			Submit();
+		WaitOldest();
+	}
+
+	const VkDeviceSize offset = position % _size;
+	memcpy(_data + offset, data, static_cast<size_t>(size));
+	_buffer.Flush(offset, size);
+	_head = position + size;
+
+	buffer = _buffer.GetBuffer();
+	return offset;
+}
+
+void StagingRing::WaitOldest()
+{
+	Batch& batch = _pending.front();
+	if (!batch.graphicsSubmitted)
+	{
+		vkWaitForFences(_device, 1, &batch.transferFence, VK_TRUE, UINT64_MAX);
+		SubmitGraphics(batch);
+	}
+	vkWaitForFences(_device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+
+	Retire(batch);
+	_pending.pop_front();
+}
+
+void StagingRing::Retire(Batch& batch)
+{
+	for (Buffer& overflow : batch.overflow)
+		overflow.Destroy(_device);
+	batch.overflow.clear();
+
+	vkResetFences(_device, 1, &batch.fence);
+	vkResetCommandBuffer(batch.graphicsCommands, 0);
+	if (_ownershipTransfer)
+	{
+		vkResetFences(_device, 1, &batch.transferFence);
+		vkResetCommandBuffer(batch.transferCommands, 0);
+	}
+
+	_tail = batch.end;
+	_completedBatch = batch.id;
+	_freeBatches.push_back(std::move(batch));
+}
@@ -4,15 +4,29 @@
 #include <stb_image.h>
 
 #define TEXTURE_PATH "Media/chalet.jpg"
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
+#include <iostream>
 #include "Buffer.h"
 
 #include "Helpers.h"
+#include "Ktx2.h"
+#include "CommandBuffer.h"
 
-void Texture::Load(const char* file)
+VkDeviceSize TextureMipSource::GetSize(uint32_t baseLevel) const
 {
-	if (file == "")
+	return levels.empty() ? 0 : data.size() - levels[baseLevel].offset;
+}
+
+void Texture::Load(const char* file, VkPhysicalDevice physicalDevice)
+{
+	if (file == nullptr || file[0] == '\0')
+		return;
+
+	if (physicalDevice != VK_NULL_HANDLE && LoadKtx2(Ktx2File::GetPath(file).c_str(), physicalDevice))
 		return;
+
 	int texChannels;
 	_pixels = stbi_load(file, &_texWidth, &_texHeight, &texChannels, STBI_rgb_alpha);
 
@@ -20,75 +34,264 @@ void Texture::Load(const char* file)
 		throw std::runtime_error("failed to load texture image!");
 }
 
+bool Texture::LoadKtx2(const char* file, VkPhysicalDevice physicalDevice)
+{
+	Ktx2File ktx;
+	if (!ktx.Open(file))
+		return false;
+
+	if (!SupportsSampling(physicalDevice, ktx.GetFormat()))
+	{
+		std::cerr << "texture: " << file << " format " << ktx.GetFormat() << " not supported, decoding the source instead" << std::endl;
+		return false;
+	}
+
+	// Copy regions need offsets aligned to the block size and to 4 bytes, 16 covers every block format
+	const size_t alignment = 16;
+	_compressedLevels.resize(ktx.GetLevelCount());
+
+	size_t size = 0;
+	for (uint32_t i = 0; i < ktx.GetLevelCount(); ++i)
+	{
+		uint64_t levelSize;
+		ktx.GetLevelData(i, levelSize);
+
+		size = (size + alignment - 1) & ~(alignment - 1);
+		_compressedLevels[i] = { size, std::max(ktx.GetWidth() >> i, 1u), std::max(ktx.GetHeight() >> i, 1u) };
+		size += static_cast<size_t>(levelSize);
+	}
+
+	_compressedData.resize(size);
+	for (uint32_t i = 0; i < ktx.GetLevelCount(); ++i)
+	{
+		uint64_t levelSize;
+		const unsigned char* data = ktx.GetLevelData(i, levelSize);
+		memcpy(_compressedData.data() + _compressedLevels[i].offset, data, static_cast<size_t>(levelSize));
+	}
+
+	_format = ktx.GetFormat();
+	_texWidth = static_cast<int>(ktx.GetWidth());
+	_texHeight = static_cast<int>(ktx.GetHeight());
+	ktx.Close();
+
+	return true;
+}
+
+void Texture::FreePixels()
+{
+	stbi_image_free(_pixels);
+	_pixels = nullptr;
+	_compressedData = {};
+	_compressedLevels = {};
+}
+
+void Texture::LoadPixels(const unsigned char* pixels, int width, int height)
+{
+	size_t size = static_cast<size_t>(width) * height * 4;
+
+	// Allocated like stb_image does so CreateTexture releases both the same way
+	_pixels = static_cast<unsigned char*>(STBI_MALLOC(size));
+	if (!_pixels)
+		throw std::runtime_error("failed to allocate texture pixels!");
+
+	memcpy(_pixels, pixels, size);
+	_texWidth = width;
+	_texHeight = height;
+}
+
 void Texture::CreateTexture(Context context)
 {
+	Upload(context);
+	if (IsCreated())
+		CreateTextureSampler(context.device);
+}
+
+void Texture::Upload(Context context)
+{
+	if (!_compressedData.empty())
+	{
+		UploadCompressed(context);
+		return;
+	}
+
 	if (_pixels == nullptr)
 		return;
 
-	VkDeviceSize imageSize = _texWidth * _texHeight * 4;
-	Buffer stagingBuffer;
-	stagingBuffer.CreateBuffer(context, imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	_mipLevels = GetMipLevelCount(static_cast<uint32_t>(_texWidth), static_cast<uint32_t>(_texHeight));
+
+	// Blit the chain on the GPU when the format can be linearly filtered, otherwise build it here
+	// and upload every level
+	const bool blit = SupportsLinearBlit(context.physicalDevice, TEXTURE_FORMAT);
+
+	std::vector<unsigned char> chain;
+	std::vector<MipLevel> levels;
+	const unsigned char* data = _pixels;
+	VkDeviceSize imageSize = static_cast<VkDeviceSize>(_texWidth) * _texHeight * 4;
 
-	stagingBuffer.MapMemory(context.device, 0, imageSize, 0, _pixels);
+	if (blit)
+		levels.push_back({ 0, static_cast<uint32_t>(_texWidth), static_cast<uint32_t>(_texHeight) });
+	else
+	{
+		GenerateMipChain(_pixels, static_cast<uint32_t>(_texWidth), static_cast<uint32_t>(_texHeight), chain, levels);
+		data = chain.data();
+		imageSize = chain.size();
+	}
+
+	CreateImage(context, _texWidth, _texHeight, TEXTURE_FORMAT, VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		_textureImage, _textureImageMemory, _mipLevels);
+
+	// Recorded into the staging batch, the copy may run on the transfer queue but blits need the graphics queue
+	context.staging->CopyToImage(data, imageSize, _textureImage, _mipLevels, levels);
 
 	stbi_image_free(_pixels);
+	_pixels = nullptr;
 
-	CreateImage(context, _texWidth, _texHeight, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
-		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		_textureImage, _textureImageMemory);
+	if (blit)
+	{
+		context.staging->FinishImage(_textureImage, _mipLevels, RESOURCE_STATE_TRANSFER_DST);
+		GenerateMipmaps(context.staging->GetGraphicsCommandBuffer());
+	}
+	else
+		context.staging->FinishImage(_textureImage, _mipLevels, RESOURCE_STATE_FRAGMENT_SHADER_READ);
+
+	CreateTextureImageView(context.device);
+}
+
+void Texture::UploadCompressed(Context context)
+{
+	TextureMipSource source;
+	if (TakeMipSource(source))
+		UploadLevels(context, source, 0);
+}
 
-	TransitionImageLayout(context, _textureImage,
-			VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	CopyBufferToImage(context, stagingBuffer, _textureImage, static_cast<uint32_t>(_texWidth), static_cast<uint32_t>(_texHeight));
-	TransitionImageLayout(context, _textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+bool Texture::TakeMipSource(TextureMipSource& source)
+{
+	if (!_compressedData.empty())
+	{
+		source.format = _format;
+		source.data = std::move(_compressedData);
+		source.levels = std::move(_compressedLevels);
+		_compressedData = {};
+		_compressedLevels = {};
+		return true;
+	}
 
-	stagingBuffer.Destroy(context.device);
+	if (_pixels == nullptr)
+		return false;
+
+	source.format = TEXTURE_FORMAT;
+	GenerateMipChain(_pixels, static_cast<uint32_t>(_texWidth), static_cast<uint32_t>(_texHeight), source.data, source.levels);
+	FreePixels();
+	return true;
+}
+
+void Texture::UploadLevels(Context context, const TextureMipSource& source, uint32_t baseLevel)
+{
+	const MipLevel& base = source.levels[baseLevel];
+	_format = source.format;
+	_texWidth = static_cast<int>(base.width);
+	_texHeight = static_cast<int>(base.height);
+	_mipLevels = static_cast<uint32_t>(source.levels.size()) - baseLevel;
+
+	// Offsets relative to the first uploaded level, which starts the staged range
+	std::vector<MipLevel> levels(source.levels.begin() + baseLevel, source.levels.end());
+	for (MipLevel& level : levels)
+		level.offset -= base.offset;
+
+	VkDeviceSize imageSize = source.GetSize(baseLevel);
+
+	CreateImage(context, _texWidth, _texHeight, _format, VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		_textureImage, _textureImageMemory, _mipLevels);
+
+	context.staging->CopyToImage(source.data.data() + base.offset, imageSize, _textureImage, _mipLevels, levels);
+	context.staging->FinishImage(_textureImage, _mipLevels, RESOURCE_STATE_FRAGMENT_SHADER_READ);
 
 	CreateTextureImageView(context.device);
-	CreateTextureSampler(context.device);
 }
 
-void Texture::CopyBufferToImage(Context context, Buffer buffer, VkImage image, uint32_t width, uint32_t height)
+bool Texture::SupportsSampling(VkPhysicalDevice physicalDevice, VkFormat format)
 {
-	CommandBuffer commandBuffer;
-	commandBuffer.BeginOneTime(context);
+	VkFormatProperties properties;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
 
-	VkBufferImageCopy region{};
-	region.bufferOffset = 0;
-	region.bufferRowLength = 0;
-	region.bufferImageHeight = 0;
+	const VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
 
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.mipLevel = 0;
-	region.imageSubresource.baseArrayLayer = 0;
-	region.imageSubresource.layerCount = 1;
+	return (properties.optimalTilingFeatures & required) == required;
+}
 
-	region.imageOffset = { 0, 0, 0 };
-	region.imageExtent = {
-		width,
-		height,
-		1
-	};
+bool Texture::SupportsLinearBlit(VkPhysicalDevice physicalDevice, VkFormat format)
+{
+	VkFormatProperties properties;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
 
-	vkCmdCopyBufferToImage(
-		commandBuffer.Get(),
-		buffer.GetBuffer(),
-		image,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		1,
-		&region
-	);
+	const VkFormatFeatureFlags required = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+		VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
 
-	commandBuffer.EndOneTime(context);
+	return (properties.optimalTilingFeatures & required) == required;
+}
+
+void Texture::GenerateMipmaps(VkCommandBuffer commandBuffer)
+{
+	VkImageSubresourceRange range = {};
+	range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	range.baseArrayLayer = 0;
+	range.layerCount = 1;
+	range.levelCount = 1;
+
+	int32_t mipWidth = _texWidth;
+	int32_t mipHeight = _texHeight;
+
+	// Each level is blitted from the previous one, only the source level has to wait on its writes
+	for (uint32_t i = 1; i < _mipLevels; i++)
+	{
+		range.baseMipLevel = i - 1;
+		BarrierBatch().AddImage(_textureImage, range, RESOURCE_STATE_TRANSFER_DST, RESOURCE_STATE_TRANSFER_SRC).Flush(commandBuffer);
+
+		VkImageBlit blit = {};
+		blit.srcOffsets[0] = { 0, 0, 0 };
+		blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.srcSubresource.mipLevel = i - 1;
+		blit.srcSubresource.baseArrayLayer = 0;
+		blit.srcSubresource.layerCount = 1;
+		blit.dstOffsets[0] = { 0, 0, 0 };
+		blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
+		blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.dstSubresource.mipLevel = i;
+		blit.dstSubresource.baseArrayLayer = 0;
+		blit.dstSubresource.layerCount = 1;
+
+		vkCmdBlitImage(commandBuffer, _textureImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			_textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+		if (mipWidth > 1)
+			mipWidth /= 2;
+		if (mipHeight > 1)
+			mipHeight /= 2;
+	}
+
+	// Every level to its final layout at once, the blitted sources and the last level written
+	BarrierBatch barriers;
+	if (_mipLevels > 1)
+	{
+		range.baseMipLevel = 0;
+		range.levelCount = _mipLevels - 1;
+		barriers.AddImage(_textureImage, range, RESOURCE_STATE_TRANSFER_SRC, RESOURCE_STATE_FRAGMENT_SHADER_READ);
+	}
+	range.baseMipLevel = _mipLevels - 1;
+	range.levelCount = 1;
+	barriers.AddImage(_textureImage, range, RESOURCE_STATE_TRANSFER_DST, RESOURCE_STATE_FRAGMENT_SHADER_READ);
+	barriers.Flush(commandBuffer);
 }
 
 void Texture::CreateTextureImageView(VkDevice device)
 {
-	_textureImageView = CreateImageView(device, _textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
+	_textureImageView = CreateImageView(device, _textureImage, _format, VK_IMAGE_ASPECT_COLOR_BIT, _mipLevels);
 }
 
-void Texture::CreateTextureSampler(VkDevice device)
+VkSamplerCreateInfo Texture::GetSamplerInfo() const
 {
 	VkSamplerCreateInfo samplerInfo = {};
 	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -106,7 +309,15 @@ void Texture::CreateTextureSampler(VkDevice device)
 	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 	samplerInfo.mipLodBias = 0.0f;
 	samplerInfo.minLod = 0.0f;
-	samplerInfo.maxLod = 0.0f;
+	// Not clamped to this texture's chain so one sampler fits every texture sampled the same way
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+	return samplerInfo;
+}
+
+void Texture::CreateTextureSampler(VkDevice device)
+{
+	VkSamplerCreateInfo samplerInfo = GetSamplerInfo();
 
 	if (vkCreateSampler(device, &samplerInfo, nullptr, &_textureSampler) != VK_SUCCESS)
 		throw std::runtime_error("failed to create texture sampler!");
@@ -115,8 +326,18 @@ void Texture::CreateTextureSampler(VkDevice device)
 void Texture::Destroy(VkDevice device)
 {
 	vkDestroySampler(device, _textureSampler, nullptr);
+	_textureSampler = VK_NULL_HANDLE;
+	DestroyImage(device);
+}
+
+void Texture::DestroyImage(VkDevice device)
+{
 	vkDestroyImageView(device, _textureImageView, nullptr);
 
 	vkDestroyImage(device, _textureImage, nullptr);
-	vkFreeMemory(device, _textureImageMemory, nullptr);
+	if (_textureImageMemory.allocator != nullptr)
+		_textureImageMemory.allocator->Free(_textureImageMemory);
+
+	_textureImageView = VK_NULL_HANDLE;
+	_textureImage = VK_NULL_HANDLE;
 }
\ No newline at end of file
@@ -0,0 +1,63 @@
+#include "TextureEncoder.h"
+#include "Ktx2.h"
+#include "MipGenerator.h"
+
+#include <stb_image.h>
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+void EncodeTexture(const char* sourceFile, BlockFormat format)
+{
+	int width;
+	int height;
+	int channels;
+	unsigned char* pixels = stbi_load(sourceFile, &width, &height, &channels, STBI_rgb_alpha);
+	if (!pixels)
+		throw std::runtime_error(std::string("failed to load ") + sourceFile);
+
+	std::vector<unsigned char> chain;
+	std::vector<MipLevel> levels;
+	GenerateMipChain(pixels, static_cast<uint32_t>(width), static_cast<uint32_t>(height), chain, levels);
+	stbi_image_free(pixels);
+
+	std::vector<std::vector<unsigned char>> blocks(levels.size());
+	for (size_t i = 0; i < levels.size(); ++i)
+		CompressImage(chain.data() + levels[i].offset, levels[i].width, levels[i].height, format, blocks[i]);
+
+	Ktx2File::Write(Ktx2File::GetPath(sourceFile).c_str(), GetBlockVkFormat(format), GetBlockSize(format),
+		static_cast<uint32_t>(width), static_cast<uint32_t>(height), blocks);
+}
+
+int RunTextureEncoder(int argc, char** argv)
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	BlockFormat format;
+	if (argc < 2 || !ParseBlockFormat(argv[0], format))
+	{
+		std::cout << "usage: --encode-textures <bc1|bc3|bc5|bc7> <image>..." << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	int result = EXIT_SUCCESS;
+	for (int i = 1; i < argc; ++i)
+	{
+		try
+		{
+			auto start = Clock::now();
+			EncodeTexture(argv[i], format);
+			double time = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+			std::cout << argv[i] << " -> " << Ktx2File::GetPath(argv[i]) << " (" << argv[0] << ", " << time << " ms)" << std::endl;
+		}
+		catch (const std::exception& e)
+		{
+			std::cout << argv[i] << ": " << e.what() << std::endl;
+			result = EXIT_FAILURE;
+		}
+	}
+
+	return result;
+}
@@ -0,0 +1,622 @@
+#include "TextureManager.h"
+#include "Hash.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+static_assert(offsetof(VkSamplerCreateInfo, unnormalizedCoordinates) + sizeof(VkBool32) - offsetof(VkSamplerCreateInfo, flags) == 16 * sizeof(uint32_t),
+	"SamplerKey does not match VkSamplerCreateInfo");
+
+uint64_t TextureLoadSettings::GetHash() const
+{
+	uint32_t words[3] = { allowCompressed ? 1u : 0u, static_cast<uint32_t>(addressMode), anisotropy ? 1u : 0u };
+	return Hash64(words, sizeof(words));
+}
+
+bool TextureManager::SamplerKey::operator==(const SamplerKey& other) const
+{
+	return memcmp(words, other.words, sizeof(words)) == 0;
+}
+
+size_t TextureManager::SamplerKeyHash::operator()(const SamplerKey& key) const
+{
+	return static_cast<size_t>(Hash64(key.words, sizeof(key.words)));
+}
+
+void TextureManager::Create(VkPhysicalDevice physicalDevice)
+{
+	_physicalDevice = physicalDevice;
+}
+
+void TextureManager::Destroy(VkDevice device)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	for (Entry& entry : _entries)
+	{
+		if (entry.state == ENTRY_READY)
+			entry.texture.DestroyImage(device);
+		if (entry.pendingBatch != 0)
+			entry.pendingTexture.DestroyImage(device);
+	}
+	_entries.clear();
+	_freeEntries.clear();
+	_entryIds.clear();
+
+	for (RetiredTexture& retired : _retired)
+		retired.texture.DestroyImage(device);
+	_retired.clear();
+	_residentBytes = 0;
+
+	for (auto& sampler : _samplers)
+		vkDestroySampler(device, sampler.second, nullptr);
+	_samplers.clear();
+}
+
+std::string TextureManager::GetCanonicalPath(const std::string& file)
+{
+	std::error_code error;
+	std::filesystem::path path = std::filesystem::weakly_canonical(file, error);
+	if (error)
+		path = std::filesystem::path(file).lexically_normal();
+
+	std::string canonical = path.generic_string();
+#ifdef _WIN32
+	// Paths are case insensitive here
+	std::transform(canonical.begin(), canonical.end(), canonical.begin(), [](char c) { return static_cast<char>(tolower(c)); });
+#endif
+	return canonical;
+}
+
+bool TextureManager::Acquire(const std::string& file, const TextureLoadSettings& settings, TextureHandle& handle)
+{
+	std::string key = GetCanonicalPath(file) + '#' + std::to_string(settings.GetHash());
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto found = _entryIds.find(key);
+	if (found != _entryIds.end())
+	{
+		handle.id = found->second;
+		_entries[handle.id].refCount++;
+		return false;
+	}
+
+	if (_freeEntries.empty())
+	{
+		handle.id = static_cast<uint32_t>(_entries.size());
+		_entries.emplace_back();
+	}
+	else
+	{
+		handle.id = _freeEntries.back();
+		_freeEntries.pop_back();
+	}
+
+	Entry& entry = _entries[handle.id];
+	entry = Entry();
+	entry.key = key;
+	entry.settings = settings;
+	entry.refCount = 1;
+	_entryIds[key] = handle.id;
+
+	return true;
+}
+
+void TextureManager::Decode(const std::string& file, const TextureLoadSettings& settings, Texture& texture) const
+{
+	texture.Load(file.c_str(), settings.allowCompressed ? _physicalDevice : VK_NULL_HANDLE);
+}
+
+void TextureManager::DecodeBatch(const std::vector<std::string>& files, const TextureLoadSettings& settings,
+	std::vector<TextureDecodeResult>& results) const
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	results.clear();
+	results.resize(files.size());
+
+	ThreadPool::Get().ParallelFor(files.size(), [&](size_t i)
+	{
+		auto start = Clock::now();
+		try
+		{
+			Decode(files[i], settings, results[i].texture);
+		}
+		catch (const std::exception& e)
+		{
+			results[i].error = e.what();
+		}
+		catch (...)
+		{
+			results[i].error = "unknown error";
+		}
+		results[i].milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	});
+}
+
+void TextureManager::PrintDecodeResults(const std::vector<std::string>& files, const std::vector<TextureDecodeResult>& results, double totalMilliseconds)
+{
+	if (files.empty())
+		return;
+
+	double sum = 0.0;
+	for (size_t i = 0; i < files.size(); ++i)
+	{
+		const TextureDecodeResult& result = results[i];
+		sum += result.milliseconds;
+
+		if (!result.error.empty())
+			std::cerr << "texture decode: " << files[i] << ": " << result.error << std::endl;
+		else
+			std::cout << "texture decode: " << files[i] << " " << result.texture.GetWidth() << "x" << result.texture.GetHeight()
+				<< (result.texture.IsCompressed() ? " ktx2" : " rgba8") << " in " << result.milliseconds << " ms" << std::endl;
+	}
+
+	std::cout << "texture decode: " << files.size() << " files in " << totalMilliseconds << " ms (" << sum << " ms summed)" << std::endl;
+}
+
+TextureManager::PendingUpload TextureManager::RecordUpload(Context context, TextureHandle handle, Texture& texture)
+{
+	bool streaming;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		streaming = _streaming;
+	}
+
+	PendingUpload upload;
+	upload.handle = handle;
+	try
+	{
+		if (streaming && texture.TakeMipSource(upload.source))
+		{
+			// Only the coarse end first, finer levels are streamed in once the texture is seen
+			const std::vector<MipLevel>& levels = upload.source.levels;
+			upload.baseLevel = static_cast<uint32_t>(levels.size()) - 1;
+			while (upload.baseLevel > 0 && std::max(levels[upload.baseLevel - 1].width, levels[upload.baseLevel - 1].height) <= TEXTURE_STREAMING_BASE_SIZE)
+				upload.baseLevel--;
+
+			texture.UploadLevels(context, upload.source, upload.baseLevel);
+		}
+		else
+			texture.Upload(context);
+
+		if (!texture.IsCreated())
+			throw std::runtime_error("texture has no pixels");
+	}
+	catch (...)
+	{
+		// The staging batch may already hold commands using the image
+		context.staging->Flush();
+		texture.FreePixels();
+		texture.DestroyImage(context.device);
+		Abandon(handle);
+		throw;
+	}
+
+	upload.texture = texture;
+	return upload;
+}
+
+void TextureManager::CompleteUpload(VkDevice device, PendingUpload& upload)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		Entry& entry = _entries[upload.handle.id];
+
+		VkSamplerCreateInfo samplerInfo = upload.texture.GetSamplerInfo();
+		samplerInfo.addressModeU = entry.settings.addressMode;
+		samplerInfo.addressModeV = entry.settings.addressMode;
+		samplerInfo.addressModeW = entry.settings.addressMode;
+		samplerInfo.anisotropyEnable = entry.settings.anisotropy ? VK_TRUE : VK_FALSE;
+		upload.texture.SetSampler(GetSamplerLocked(device, samplerInfo));
+
+		entry.texture = upload.texture;
+		entry.state = ENTRY_READY;
+
+		if (!upload.source.levels.empty())
+		{
+			entry.source = std::move(upload.source);
+			entry.baseLevel = upload.baseLevel;
+			entry.residentLevel = upload.baseLevel;
+			entry.targetLevel = upload.baseLevel;
+			_residentBytes += entry.source.GetSize(upload.baseLevel);
+		}
+	}
+	_readyCondition.notify_all();
+}
+
+void TextureManager::Publish(Context context, TextureHandle handle, Texture& texture)
+{
+	PendingUpload upload = RecordUpload(context, handle, texture);
+
+	// Ready means resident, other threads may use the image as soon as it is published
+	context.staging->Flush();
+	CompleteUpload(context.device, upload);
+}
+
+void TextureManager::PublishBatch(Context context, const std::vector<TextureHandle>& handles, std::vector<TextureDecodeResult>& results,
+	const std::vector<std::string>& files)
+{
+	std::vector<PendingUpload> uploads;
+	uploads.reserve(handles.size());
+	for (size_t k = 0; k < handles.size(); ++k)
+	{
+		if (!results[k].error.empty())
+		{
+			Abandon(handles[k]);
+			continue;
+		}
+
+		try
+		{
+			uploads.push_back(RecordUpload(context, handles[k], results[k].texture));
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "texture upload: " << files[k] << ": " << e.what() << std::endl;
+		}
+	}
+
+	// Every upload of the batch in one submission
+	context.staging->Flush();
+	for (PendingUpload& upload : uploads)
+		CompleteUpload(context.device, upload);
+}
+
+void TextureManager::Abandon(TextureHandle handle)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		Entry& entry = _entries[handle.id];
+
+		entry.state = ENTRY_FAILED;
+		auto found = _entryIds.find(entry.key);
+		if (found != _entryIds.end() && found->second == handle.id)
+			_entryIds.erase(found);
+	}
+	_readyCondition.notify_all();
+}
+
+bool TextureManager::WaitReady(TextureHandle handle)
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_readyCondition.wait(lock, [this, handle]() { return _entries[handle.id].state != ENTRY_LOADING; });
+
+	return _entries[handle.id].state == ENTRY_READY;
+}
+
+TextureHandle TextureManager::Load(Context context, const std::string& file, const TextureLoadSettings& settings)
+{
+	TextureHandle handle;
+	if (Acquire(file, settings, handle))
+	{
+		Texture texture;
+		try
+		{
+			Decode(file, settings, texture);
+		}
+		catch (...)
+		{
+			texture.FreePixels();
+			Abandon(handle);
+			Release(handle);
+			throw;
+		}
+
+		try
+		{
+			Publish(context, handle, texture);
+		}
+		catch (...)
+		{
+			Release(handle);
+			throw;
+		}
+	}
+	else if (!WaitReady(handle))
+	{
+		Release(handle);
+		throw std::runtime_error("failed to load texture " + file);
+	}
+
+	return handle;
+}
+
+std::vector<TextureHandle> TextureManager::LoadBatch(Context context, const std::vector<std::string>& files, const TextureLoadSettings& settings)
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	std::vector<TextureHandle> handles(files.size());
+	std::vector<std::string> decodeFiles;
+	std::vector<size_t> decodeIndices;
+	for (size_t i = 0; i < files.size(); ++i)
+	{
+		if (Acquire(files[i], settings, handles[i]))
+		{
+			decodeFiles.push_back(files[i]);
+			decodeIndices.push_back(i);
+		}
+	}
+
+	auto start = Clock::now();
+	std::vector<TextureDecodeResult> results;
+	DecodeBatch(decodeFiles, settings, results);
+	PrintDecodeResults(decodeFiles, results, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+
+	// Publish every new texture before waiting, a file listed twice waits on its first entry
+	std::vector<TextureHandle> decodeHandles;
+	for (size_t i : decodeIndices)
+		decodeHandles.push_back(handles[i]);
+	PublishBatch(context, decodeHandles, results, decodeFiles);
+
+	for (TextureHandle& handle : handles)
+	{
+		if (!WaitReady(handle))
+		{
+			Release(handle);
+			handle = TextureHandle();
+		}
+	}
+
+	return handles;
+}
+
+void TextureManager::AddRef(TextureHandle handle)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_entries[handle.id].refCount++;
+}
+
+void TextureManager::Release(TextureHandle handle)
+{
+	if (!handle.IsValid())
+		return;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	_entries[handle.id].refCount--;
+}
+
+void TextureManager::DestroyUnused(VkDevice device)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	for (uint32_t id = 0; id < _entries.size(); ++id)
+	{
+		Entry& entry = _entries[id];
+		if (entry.refCount > 0 || entry.state == ENTRY_LOADING || entry.key.empty())
+			continue;
+
+		if (entry.state == ENTRY_READY)
+		{
+			entry.texture.DestroyImage(device);
+			_entryIds.erase(entry.key);
+
+			if (entry.pendingBatch != 0)
+			{
+				entry.pendingTexture.DestroyImage(device);
+				entry.residentLevel = entry.pendingLevel;
+			}
+			if (!entry.source.levels.empty())
+				_residentBytes -= entry.source.GetSize(entry.residentLevel);
+		}
+
+		entry = Entry();
+		_freeEntries.push_back(id);
+	}
+}
+
+bool TextureManager::IsReady(TextureHandle handle)
+{
+	if (!handle.IsValid())
+		return false;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _entries[handle.id].state == ENTRY_READY;
+}
+
+const Texture& TextureManager::GetTexture(TextureHandle handle)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _entries[handle.id].texture;
+}
+
+VkSampler TextureManager::GetSampler(VkDevice device, const VkSamplerCreateInfo& info)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return GetSamplerLocked(device, info);
+}
+
+VkSampler TextureManager::GetSamplerLocked(VkDevice device, const VkSamplerCreateInfo& info)
+{
+	SamplerKey key;
+	memcpy(key.words, &info.flags, sizeof(key.words));
+
+	auto found = _samplers.find(key);
+	if (found != _samplers.end())
+		return found->second;
+
+	VkSampler sampler;
+	if (vkCreateSampler(device, &info, nullptr, &sampler) != VK_SUCCESS)
+		throw std::runtime_error("failed to create texture sampler!");
+
+	_samplers[key] = sampler;
+	return sampler;
+}
+
+void TextureManager::EnableStreaming(VkDeviceSize budget)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_streaming = true;
+	_streamingBudget = budget;
+}
+
+VkDeviceSize TextureManager::GetResidentBytes()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _residentBytes;
+}
+
+void TextureManager::RequestResolution(TextureHandle handle, float pixels)
+{
+	if (!handle.IsValid())
+		return;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	Entry& entry = _entries[handle.id];
+	if (entry.state != ENTRY_READY || entry.source.levels.empty())
+		return;
+
+	// Coarsest level that still has at least one texel per pixel
+	const std::vector<MipLevel>& levels = entry.source.levels;
+	uint32_t level = entry.baseLevel;
+	while (level > 0 && static_cast<float>(std::max(levels[level].width, levels[level].height)) < pixels)
+		level--;
+
+	entry.requestedLevel = std::min(entry.requestedLevel, level);
+}
+
+void TextureManager::UpdateStreaming(Context context, uint64_t frame, uint64_t retireFrame, std::vector<TextureHandle>& changed)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	// Images whose upload completed replace the ones sampled so far
+	for (uint32_t id = 0; id < _entries.size(); ++id)
+	{
+		Entry& entry = _entries[id];
+		if (entry.pendingBatch == 0 || !context.staging->IsComplete(entry.pendingBatch))
+			continue;
+
+		// The old image may still be bound by frames in flight
+		entry.pendingTexture.SetSampler(entry.texture.GetSampler());
+		_retired.push_back({ entry.texture, retireFrame });
+
+		entry.texture = entry.pendingTexture;
+		entry.residentLevel = entry.pendingLevel;
+		entry.pendingTexture = Texture();
+		entry.pendingBatch = 0;
+
+		TextureHandle handle;
+		handle.id = id;
+		changed.push_back(handle);
+	}
+
+	// Textures not requested this frame only need their base levels, what is above is kept until evicted.
+	// One image is uploaded at a time per texture.
+	std::vector<uint32_t> upgrades;
+	for (uint32_t id = 0; id < _entries.size(); ++id)
+	{
+		Entry& entry = _entries[id];
+		if (entry.state != ENTRY_READY || entry.source.levels.empty() || entry.pendingBatch != 0)
+			continue;
+
+		entry.targetLevel = entry.baseLevel;
+		if (entry.requestedLevel != UINT32_MAX)
+		{
+			entry.targetLevel = entry.requestedLevel;
+			entry.lastRequestFrame = frame;
+			entry.requestedLevel = UINT32_MAX;
+		}
+
+		if (entry.targetLevel < entry.residentLevel)
+			upgrades.push_back(id);
+	}
+
+	// Largest shortfall first
+	std::sort(upgrades.begin(), upgrades.end(), [this](uint32_t a, uint32_t b)
+	{
+		return _entries[a].residentLevel - _entries[a].targetLevel > _entries[b].residentLevel - _entries[b].targetLevel;
+	});
+
+	for (uint32_t id : upgrades)
+	{
+		Entry& entry = _entries[id];
+		const uint32_t level = entry.residentLevel - 1;
+
+		// The whole chain from level down is uploaded again, one that does not fit leaves the room to smaller ones
+		if (!context.staging->FitsFrameBudget(entry.source.GetSize(level)))
+			continue;
+		const VkDeviceSize growth = entry.source.GetSize(level) - entry.source.GetSize(entry.residentLevel);
+
+		while (_residentBytes + growth > _streamingBudget)
+		{
+			uint32_t victim = FindEvictionCandidate(id);
+			if (victim == UINT32_MAX || !SetResidentLevel(context, victim, _entries[victim].residentLevel + 1))
+				break;
+		}
+
+		if (_residentBytes + growth > _streamingBudget || !SetResidentLevel(context, id, level))
+			break;
+	}
+
+	// Also after the budget was lowered
+	while (_residentBytes > _streamingBudget)
+	{
+		uint32_t victim = FindEvictionCandidate(UINT32_MAX);
+		if (victim == UINT32_MAX || !SetResidentLevel(context, victim, _entries[victim].residentLevel + 1))
+			break;
+	}
+}
+
+void TextureManager::CollectGarbage(VkDevice device, uint64_t frame)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	size_t kept = 0;
+	for (size_t i = 0; i < _retired.size(); ++i)
+	{
+		if (_retired[i].frame <= frame)
+			_retired[i].texture.DestroyImage(device);
+		else
+			_retired[kept++] = _retired[i];
+	}
+	_retired.resize(kept);
+}
+
+bool TextureManager::SetResidentLevel(Context context, uint32_t id, uint32_t level)
+{
+	Entry& entry = _entries[id];
+
+	Texture texture;
+	try
+	{
+		texture.UploadLevels(context, entry.source, level);
+	}
+	catch (const std::exception& e)
+	{
+		context.staging->Flush();
+		texture.DestroyImage(context.device);
+		std::cerr << "texture streaming: " << entry.key << ": " << e.what() << std::endl;
+		return false;
+	}
+
+	// Counted from now on so the budget holds while the upload is in flight
+	_residentBytes = _residentBytes - entry.source.GetSize(entry.residentLevel) + entry.source.GetSize(level);
+	entry.pendingTexture = texture;
+	entry.pendingLevel = level;
+	entry.pendingBatch = context.staging->GetCurrentBatch();
+
+	return true;
+}
+
+uint32_t TextureManager::FindEvictionCandidate(uint32_t excluded) const
+{
+	uint32_t candidate = UINT32_MAX;
+	for (uint32_t id = 0; id < _entries.size(); ++id)
+	{
+		const Entry& entry = _entries[id];
+		if (id == excluded || entry.state != ENTRY_READY || entry.source.levels.empty() || entry.pendingBatch != 0 ||
+			entry.residentLevel >= entry.targetLevel)
+			continue;
+
+		if (candidate == UINT32_MAX || entry.lastRequestFrame < _entries[candidate].lastRequestFrame)
+			candidate = id;
+	}
+
+	return candidate;
+}
@@ -0,0 +1,131 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+{
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency()) - 1;
+
+	threadCount = std::max(1u, threadCount);
+
+	for (uint32_t i = 0; i < threadCount; ++i)
+		_threads.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_condition.notify_all();
+
+	for (std::thread& thread : _threads)
+		thread.join();
+}
+
+ThreadPool& ThreadPool::Get()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::Enqueue(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_tasks.push(std::move(task));
+	}
+	_condition.notify_one();
+}
+
+void ThreadPool::WorkerLoop()
+{
+	while (true)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_condition.wait(lock, [this]() { return _stop || !_tasks.empty(); });
+
+			if (_stop && _tasks.empty())
+				return;
+
+			task = std::move(_tasks.front());
+			_tasks.pop();
+		}
+
+		task();
+	}
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& func)
+{
+	if (count == 0)
+		return;
+
+	if (count == 1)
+	{
+		func(0);
+		return;
+	}
+
+	struct State
+	{
+		std::atomic<size_t>		next { 0 };
+		size_t					done = 0;
+		size_t					count = 0;
+		std::exception_ptr		error;
+		std::mutex				mutex;
+		std::condition_variable	condition;
+	};
+
+	auto state = std::make_shared<State>();
+	state->count = count;
+
+	// Helpers and the caller claim indices from the same counter, so helpers that only get
+	// scheduled after the caller drained everything simply find no work left
+	auto run = [state, &func]()
+	{
+		size_t finished = 0;
+		std::exception_ptr error;
+
+		for (size_t i = state->next++; i < state->count; i = state->next++)
+		{
+			try
+			{
+				func(i);
+			}
+			catch (...)
+			{
+				if (!error)
+					error = std::current_exception();
+			}
+			++finished;
+		}
+
+		if (finished == 0)
+			return;
+
+		std::lock_guard<std::mutex> lock(state->mutex);
+		if (error && !state->error)
+			state->error = error;
+		state->done += finished;
+		if (state->done == state->count)
+			state->condition.notify_all();
+	};
+
+	size_t helpers = std::min(count - 1, _threads.size());
+	for (size_t i = 0; i < helpers; ++i)
+		Enqueue(run);
+
+	run();
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->condition.wait(lock, [&state]() { return state->done == state->count; });
+
+	if (state->error)
+		std::rethrow_exception(state->error);
+}
@@ -1,5 +1,9 @@
 #include "Vertex.h"
 
+#include <glm/gtc/packing.hpp>
+
+#include <cmath>
+
 VkVertexInputBindingDescription Vertex::GetBindingDescription()
 {
 	VkVertexInputBindingDescription bindingDescription{};
@@ -30,4 +34,90 @@ std::array<VkVertexInputAttributeDescription, 3> Vertex::GetAttributeDescription
 	attributeDescriptions[2].offset = offsetof(Vertex, texCoord);
 
 	return attributeDescriptions;
-}
\ No newline at end of file
+}
+
+VkVertexInputBindingDescription PackedVertex::GetBindingDescription()
+{
+	VkVertexInputBindingDescription bindingDescription{};
+
+	bindingDescription.binding = 0;
+	bindingDescription.stride = sizeof(PackedVertex);
+	bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+	return bindingDescription;
+}
+
+std::array<VkVertexInputAttributeDescription, 3> PackedVertex::GetAttributeDescriptions()
+{
+	std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions = {};
+	attributeDescriptions[0].binding = 0;
+	attributeDescriptions[0].location = 0;
+	attributeDescriptions[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+	attributeDescriptions[0].offset = offsetof(PackedVertex, pos);
+
+	attributeDescriptions[1].binding = 0;
+	attributeDescriptions[1].location = 1;
+	attributeDescriptions[1].format = VK_FORMAT_R16G16_SNORM;
+	attributeDescriptions[1].offset = offsetof(PackedVertex, normal);
+
+	attributeDescriptions[2].binding = 0;
+	attributeDescriptions[2].location = 2;
+	attributeDescriptions[2].format = VK_FORMAT_R16G16_SFLOAT;
+	attributeDescriptions[2].offset = offsetof(PackedVertex, texCoord);
+
+	return attributeDescriptions;
+}
+
+static int16_t PackSnorm16(float value)
+{
+	return static_cast<int16_t>(std::round(glm::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+PackedVertex PackedVertex::Pack(const Vertex& vertex, const Bounds& bounds)
+{
+	PackedVertex packed = {};
+
+	glm::vec3 extent = bounds.GetExtent();
+	for (int i = 0; i < 3; ++i)
+	{
+		float normalized = extent[i] > 0.0f ? (vertex.pos[i] - bounds.min[i]) / extent[i] : 0.0f;
+		packed.pos[i] = static_cast<uint16_t>(std::round(glm::clamp(normalized, 0.0f, 1.0f) * 65535.0f));
+	}
+
+	// Octahedral mapping: project on the |x|+|y|+|z| = 1 octahedron and fold the lower half over
+	glm::vec3 normal = vertex.normal;
+	float sum = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+	glm::vec2 octahedral(0.0f);
+	if (sum > 0.0f)
+	{
+		normal /= sum;
+		octahedral = glm::vec2(normal.x, normal.y);
+		if (normal.z < 0.0f)
+		{
+			octahedral.x = (1.0f - std::abs(normal.y)) * (normal.x >= 0.0f ? 1.0f : -1.0f);
+			octahedral.y = (1.0f - std::abs(normal.x)) * (normal.y >= 0.0f ? 1.0f : -1.0f);
+		}
+	}
+	packed.normal[0] = PackSnorm16(octahedral.x);
+	packed.normal[1] = PackSnorm16(octahedral.y);
+
+	packed.texCoord[0] = glm::packHalf1x16(vertex.texCoord.x);
+	packed.texCoord[1] = glm::packHalf1x16(vertex.texCoord.y);
+
+	return packed;
+}
+
+uint32_t GetVertexStride(VertexFormat format)
+{
+	return format == VERTEX_FORMAT_PACKED ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+VkVertexInputBindingDescription GetBindingDescription(VertexFormat format)
+{
+	return format == VERTEX_FORMAT_PACKED ? PackedVertex::GetBindingDescription() : Vertex::GetBindingDescription();
+}
+
+std::array<VkVertexInputAttributeDescription, 3> GetAttributeDescriptions(VertexFormat format)
+{
+	return format == VERTEX_FORMAT_PACKED ? PackedVertex::GetAttributeDescriptions() : Vertex::GetAttributeDescriptions();
+}
@@ -0,0 +1,242 @@
+#include "VertexWelder.h"
+#include "ThreadPool.h"
+#include "Hash.h"
+
+#include <cmath>
+#include <cstring>
+
+// Corners welded by one task, a multiple of three so triangles are never split
+#define WELD_RANGE_SIZE (3 << 16)
+
+namespace
+{
+	// Vertex attributes packed without the padding of the aligned glm types, positions are
+	// either the raw float bits or grid cell coordinates when welding with a tolerance
+	struct WeldKey
+	{
+		uint32_t words[8];
+
+		bool operator==(const WeldKey& other) const
+		{
+			return memcmp(words, other.words, sizeof(words)) == 0;
+		}
+	};
+
+	inline uint32_t FloatBits(float value)
+	{
+		// -0 and +0 compare equal as floats, keep them equal as keys
+		if (value == 0.0f)
+			value = 0.0f;
+
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	inline WeldKey MakeKey(const Vertex& vertex, float inverseTolerance)
+	{
+		WeldKey key;
+
+		if (inverseTolerance > 0.0f)
+		{
+			for (int i = 0; i < 3; ++i)
+				key.words[i] = static_cast<uint32_t>(static_cast<int32_t>(std::floor(vertex.pos[i] * inverseTolerance)));
+		}
+		else
+		{
+			for (int i = 0; i < 3; ++i)
+				key.words[i] = FloatBits(vertex.pos[i]);
+		}
+
+		key.words[3] = FloatBits(vertex.normal.x);
+		key.words[4] = FloatBits(vertex.normal.y);
+		key.words[5] = FloatBits(vertex.normal.z);
+		key.words[6] = FloatBits(vertex.texCoord.x);
+		key.words[7] = FloatBits(vertex.texCoord.y);
+
+		return key;
+	}
+
+	// Linear probing table of vertex ids, the upper hash bits are kept next to each id so most
+	// probes are rejected without touching the key array
+	class WeldTable
+	{
+	public:
+		explicit WeldTable(size_t expectedCount)
+		{
+			size_t capacity = 16;
+			while (capacity < expectedCount * 2)
+				capacity <<= 1;
+
+			_slots.assign(capacity, { EMPTY_SLOT, 0 });
+			_mask = capacity - 1;
+		}
+
+		// Returns the id of an equal key already in the table, or inserts id and returns it
+		uint32_t Insert(const WeldKey& key, uint32_t id, const std::vector<WeldKey>& keys)
+		{
+			uint64_t hash = Hash64(key.words, sizeof(key.words));
+			uint32_t tag = static_cast<uint32_t>(hash >> 32);
+
+			for (size_t slot = hash & _mask;; slot = (slot + 1) & _mask)
+			{
+				Slot& current = _slots[slot];
+				if (current.id == EMPTY_SLOT)
+				{
+					current = { id, tag };
+					return id;
+				}
+
+				if (current.tag == tag && keys[current.id] == key)
+					return current.id;
+			}
+		}
+
+	private:
+		static const uint32_t EMPTY_SLOT = UINT32_MAX;
+
+		struct Slot
+		{
+			uint32_t id;
+			uint32_t tag;
+		};
+
+		std::vector<Slot>	_slots;
+		size_t				_mask;
+	};
+
+	struct WeldRange
+	{
+		uint32_t				firstIndex;
+		uint32_t				indexCount;
+		std::vector<Vertex>		vertices;
+		std::vector<WeldKey>	keys;
+	};
+
+	inline Vertex MakeVertex(const ObjIndex& index, const std::vector<float>& positions,
+		const std::vector<float>& normals, const std::vector<float>& texCoords)
+	{
+		Vertex vertex = {};
+
+		vertex.pos = {
+			positions[3 * index.vertex + 0],
+			positions[3 * index.vertex + 1],
+			positions[3 * index.vertex + 2]
+		};
+
+		if (index.texCoord >= 0)
+		{
+			vertex.texCoord = {
+				texCoords[2 * index.texCoord + 0],
+				1.0f - texCoords[2 * index.texCoord + 1]
+			};
+		}
+
+		if (index.normal >= 0)
+		{
+			vertex.normal = {
+				normals[3 * index.normal + 0],
+				normals[3 * index.normal + 1],
+				normals[3 * index.normal + 2]
+			};
+		}
+
+		return vertex;
+	}
+}
+
+VertexWelder& VertexWelder::Weld(const ObjParser& parser, float positionTolerance)
+{
+	const std::vector<ObjIndex>& corners = parser.GetIndices();
+	const float inverseTolerance = positionTolerance > 0.0f ? 1.0f / positionTolerance : 0.0f;
+
+	std::vector<WeldRange> ranges;
+	for (const ObjShape& shape : parser.GetShapes())
+	{
+		for (uint32_t first = 0; first < shape.indexCount; first += WELD_RANGE_SIZE)
+		{
+			WeldRange range;
+			range.firstIndex = shape.firstIndex + first;
+			range.indexCount = std::min<uint32_t>(WELD_RANGE_SIZE, shape.indexCount - first);
+			ranges.push_back(std::move(range));
+		}
+	}
+
+	_vertices.clear();
+	_indices.resize(corners.size());
+
+	// Each range writes range local vertex ids into its slice of the index buffer
+	ThreadPool::Get().ParallelFor(ranges.size(), [&](size_t r)
+	{
+		WeldRange& range = ranges[r];
+		WeldTable table(range.indexCount);
+
+		range.vertices.reserve(range.indexCount / 2);
+		range.keys.reserve(range.indexCount / 2);
+
+		for (uint32_t i = range.firstIndex; i < range.firstIndex + range.indexCount; ++i)
+		{
+			Vertex vertex = MakeVertex(corners[i], parser.GetPositions(), parser.GetNormals(), parser.GetTexCoords());
+			WeldKey key = MakeKey(vertex, inverseTolerance);
+
+			uint32_t id = static_cast<uint32_t>(range.vertices.size());
+			range.keys.push_back(key);
+
+			_indices[i] = table.Insert(key, id, range.keys);
+			if (_indices[i] == id)
+				range.vertices.push_back(vertex);
+			else
+				range.keys.pop_back();
+		}
+	});
+
+	if (ranges.size() == 1)
+	{
+		_vertices = std::move(ranges[0].vertices);
+		return *this;
+	}
+
+	// Merge: ranges share vertices along their borders, weld the (much smaller) per range
+	// results against each other in order so vertex order stays first-use order
+	size_t uniqueCount = 0;
+	std::vector<size_t> rangeBase(ranges.size());
+	for (size_t r = 0; r < ranges.size(); ++r)
+	{
+		rangeBase[r] = uniqueCount;
+		uniqueCount += ranges[r].vertices.size();
+	}
+
+	std::vector<uint32_t> remap(uniqueCount);
+	std::vector<WeldKey> keys;
+	keys.reserve(uniqueCount);
+	_vertices.reserve(uniqueCount);
+	WeldTable table(uniqueCount);
+
+	for (size_t r = 0; r < ranges.size(); ++r)
+	{
+		WeldRange& range = ranges[r];
+		for (size_t j = 0; j < range.vertices.size(); ++j)
+		{
+			uint32_t id = static_cast<uint32_t>(_vertices.size());
+			keys.push_back(range.keys[j]);
+
+			remap[rangeBase[r] + j] = table.Insert(range.keys[j], id, keys);
+			if (remap[rangeBase[r] + j] == id)
+				_vertices.push_back(range.vertices[j]);
+			else
+				keys.pop_back();
+		}
+
+		range.keys = {};
+		range.vertices = {};
+	}
+
+	ThreadPool::Get().ParallelFor(ranges.size(), [&](size_t r)
+	{
+		const WeldRange& range = ranges[r];
+		for (uint32_t i = range.firstIndex; i < range.firstIndex + range.indexCount; ++i)
+			_indices[i] = remap[rangeBase[r] + _indices[i]];
+	});
+
+	return *this;
+}
@@ -1,10 +1,28 @@
 #include "Renderer.h"
+#include "ObjParser.h"
+#include "TextureEncoder.h"
 
+#include <cstring>
 #include <stdexcept>
 #include <iostream>
 
-int main()
+int main(int argc, char** argv)
 {
+	if (argc > 1 && strcmp(argv[1], "--encode-textures") == 0)
+		return RunTextureEncoder(argc - 2, argv + 2);
+
+#ifdef OBJ_PARSER_BENCHMARK
+	try
+	{
+		return RunObjParserBenchmark("Media/fantasy_game_inn.obj", 10);
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+#endif
+
 	Application::Renderer app;
 
 	try